@@ -30,6 +30,7 @@
 #include "VapourSynth.h"
 
 #define FORMAT_MAX_LEN 32
+#define HUGE_PAGE_SIZE (2 << 20)
 
 #define LOG_PREFIX "raws: "
 
@@ -42,20 +43,78 @@
 }
 
 typedef struct rs_hndle rs_hnd_t;
-typedef void (VS_CC *func_write_frame)(const rs_hnd_t *, VSFrameRef **, const VSAPI *,
-                                       VSCore *);
+typedef struct rs_stats_t rs_stats_t;
+typedef struct rs_rows_t rs_rows_t;
+typedef void (VS_CC *func_write_frame)(const rs_hnd_t *, const uint8_t *, VSFrameRef **,
+                                       const rs_rows_t *, const VSAPI *, VSCore *);
+typedef void (VS_CC *func_pack_frame)(const rs_hnd_t *, const VSFrameRef **, uint8_t *,
+                                      const VSAPI *);
 typedef struct rs_history_t rs_history_t;
 
+#define RS_POOL_SIZE 8
+
+typedef struct {
+    FILE *file;
+    int segment;
+    unsigned tick;
+} rs_pool_entry_t;
+
 struct rs_history_t {
-    VSFrameRef* frame;
+    const VSFrameRef* frame[2];  // base and alpha clip of one decoded frame
     int frameNumber;
     rs_history_t* next;
 };
 
+// a pipe drained by a thread of its own into a ring of chunks, so that the
+// writer of the pipe doesn't wait for frames to be requested
+typedef struct {
+    int fd;
+    int num_chunks;
+    size_t chunk_size;
+    uint8_t *buff;               // num_chunks * chunk_size bytes
+    size_t *len;                 // bytes in each chunk, 0 marks the end of the pipe
+    rs_sem_t free;
+    rs_sem_t full;
+    rs_thread_t thread;
+    volatile int quit;
+    int cur;                     // chunk being read from, -1 to take the next one
+    int next;
+    size_t pos;                  // read position in cur
+    int eof;
+} rs_pipe_reader_t;
+
+// statistics of one output plane, gathered row by row as it is written
+struct rs_stats_t {
+    int bytes;                   // bytes per sample, 0 if the plane isn't measured
+    uint64_t count;
+    uint32_t min;                // integer samples
+    uint32_t max;
+    uint64_t sum;
+    float fmin;                  // float samples
+    float fmax;
+    double fsum;
+    uint32_t *hist;              // integer samples: 256 or 65536 bins, NULL if unused
+};
+
+// work done on every row right after a converter has written it: the change
+// from the source's sample format to out_format, then the statistics
+struct rs_rows_t {
+    int in_bytes;                // 0 if the samples are kept as they are
+    int out_bytes;
+    int shift;                   // integer out: bits to shift left, negative for right
+    int half;                    // half float in: widened to single, not scaled
+    float scale[3];              // float out: sample * scale + offset
+    float offset[3];
+    rs_stats_t *stats;           // NULL if the rows aren't measured here
+    int y_begin;                 // streamed frames: the stripe of output rows
+    int y_end;                   // written by this call, all of them if y_end is 0
+    int src_y;                   // source row at the start of src
+};
+
 struct rs_hndle {
     FILE *file;
     int64_t file_size;           // file size, for pipes it is -1
-    uint32_t frame_size;         // frame size in bytes
+    uint64_t frame_size;         // frame size in bytes
     char src_format[FORMAT_MAX_LEN];
     int order[4];                // order of planes/channels
     int off_header;              // distance from start of file to first frame header
@@ -66,15 +125,67 @@ struct rs_hndle {
     int has_alpha;
     int flip_v;                  // source should be flipped vertically
     int skip_first_frame_header; // first frame header was consumed in probe
-    char magic[2];               // first few bytes of file/stream to identify the file type
+    char magic[4];               // first few bytes of file/stream to identify the file type
+    int  magic_size;             // bytes of magic read, 2 or 4 for a possible DPX
     int  write_magic;            // 1 == magic needs to be written to the first frame out
     int last_frame_number;       // last frame number requested to detect out-of-order problem
+    int rsz;                     // source is a chunk-compressed container
+    uint32_t codec;              // RSZ_CODEC_* of the container
+    rs_shm_header_t *shm;        // mapped frame ring of a shm: source, else NULL
+    size_t shm_size;
+    FILE *spool;                 // pipe: copy of the frames received so far
+    int spool_frames;            // frames kept in the spool, 0 keeps all of them
+    int spooled;                 // frames read from the pipe so far
+    int spool_eof;               // pipe has ended, spooled is the real frame count
+    int pipe_direct;             // pipe is read with read() on its descriptor, not stdio
+    int pipe_peek;               // byte held back by pipe_eof, -1 if none
+    rs_pipe_reader_t *reader;    // pipe: thread reading ahead of the requests, NULL if none
+    int num_segments;            // files concatenated into the clip, 1 for a single file
+    char **segment_name;         // NULL for a single file
+    int64_t *segment_size;
+    int *index_segment;          // segment of every frame in index, NULL for a single file
+    int plane_files;             // the segments are one file per plane, read concurrently
+    FILE *plane_file[4];         // plane_files: the file of every plane in src_fmt order
+    uint64_t plane_size[4];      // plane_files: bytes of each plane of a frame
+    rs_pool_entry_t pool[RS_POOL_SIZE]; // open segments other than the first
+    unsigned pool_tick;
+    int crc;                     // compute the CRC32C of every frame's raw bytes
+    uint32_t *manifest;          // expected CRC32C of every frame, from the sidecar
+    int manifest_frames;
+    int stats;                   // 1: min, max and sum of every plane, 2: and a histogram
     int64_t *index;
+    int follow;                  // ms to wait for frames past the end of a growing file, 0 if not following
+    int index_frames;            // follow: frames in index so far
+    int index_capacity;
+    uint32_t *index_size;        // container: compressed size of every frame in index
     uint64_t *total_pix;
     uint8_t *frame_buff;
+    size_t frame_buff_mapped;    // length of the mapping when frame_buff is mmap'ed, else 0
+    size_t frame_buff_size;      // a frame, or a stripe of rows when streamed
+    int stream;                  // convert frames a stripe of rows at a time
+    int stripe_rows;             // rows per stripe of a streamed frame, 0 if not streamed
+    int hugepages;               // back raw buffers with 2MB pages where possible
+    int direct_read;             // planar frames are read straight into the output planes
+    int region;                  // output is a crop region and/or one plane of the frame
+    int crop_left;
+    int crop_top;
+    int crop_width;
+    int crop_height;
+    int plane;                   // the only plane output as gray, -1 for all of them
+    const VSFormat *plane_format;
+    const VSFormat *out_format;  // format the converters write, vi[0].format unless out_format is given
+    int region_read;             // only the bytes of the region are read from the file
+    uint8_t *span_scratch;       // sink for skipped bytes read through to join spans
+    int span_iov_max;
+#ifdef RS_HAVE_PREADV
+    struct iovec *iov;
+#endif
     func_write_frame write_frame;
+    func_pack_frame pack_frame;  // inverse of write_frame, used by Write
+    void *opaque_row;            // Write: opaque alpha for packers when there is no alpha clip
     VSVideoInfo vi[2];
-    rs_history_t* history[2];
+    rs_history_t* history;       // recently decoded frames, oldest first
+    rs_mutex_t lock;             // guards history (and the file on win32) in parallel mode
 };
 
 
@@ -87,30 +198,19 @@ typedef struct {
 } vs_args_t;
 
 
-static const char *open_source_file(rs_hnd_t *rh, const char *src_name)
+// stat and open a file for reading, *size is -1 for pipes
+static const char *open_file(const char *name, FILE **file, int64_t *size)
 {
-    // if name is -, use stdin
-    if (strcmp(src_name, "-") == 0)
-    {
-#ifdef _WIN32
-        // reopen stdin in binary mode in case it wasn't, probably only windows issue
-        _setmode(_fileno(stdin),  _O_BINARY);
-#endif
-        rh->file = stdin;
-        rh->file_size = -1;
-        return NULL;
-    }
-
 #ifdef _WIN32
     struct _stat64 st;
     wchar_t tmp[FILENAME_MAX * 4];
-    MultiByteToWideChar(CP_UTF8, 0, src_name, -1, tmp, FILENAME_MAX * 4);
+    MultiByteToWideChar(CP_UTF8, 0, name, -1, tmp, FILENAME_MAX * 4);
 
     if (_wstat64(tmp, &st) != 0) {
 #else
 
     struct stat st;
-    if (stat(src_name, &st) != 0) {
+    if (stat(name, &st) != 0) {
 #endif
         return "source does not exist.";
     }
@@ -118,19 +218,19 @@ static const char *open_source_file(rs_hnd_t *rh, const char *src_name)
     // if file is a pipe, give it negative size as an indicator
     if (st.st_size == 0) {
         if ((st.st_mode & S_IFMT) == S_IFIFO)
-            rh->file_size = -1;
+            *size = -1;
         else
             return "failed to get file size.";
     }
     else
-        rh->file_size = st.st_size;
+        *size = st.st_size;
 
 #ifdef _WIN32
-    rh->file = _wfopen(tmp, L"rb");
+    *file = _wfopen(tmp, L"rb");
 #else
-    rh->file = fopen(src_name, "rb");
+    *file = fopen(name, "rb");
 #endif
-    if (!rh->file) {
+    if (!*file) {
         return "failed to open source file";
     }
 
@@ -138,984 +238,5233 @@ static const char *open_source_file(rs_hnd_t *rh, const char *src_name)
 }
 
 
-static void VS_CC
-rs_bit_blt(uint8_t *srcp, int row_size, int height, VSFrameRef *dst, int plane,
-           const VSAPI *vsapi)
+static const char *open_source_file(rs_hnd_t *rh, const char *src_name)
 {
-    uint8_t *dstp = vsapi->getWritePtr(dst, plane);
-    int dst_stride = vsapi->getStride(dst, plane);
-
-    if (row_size == dst_stride) {
-        memcpy(dstp, srcp, row_size * height);
-        return;
+    // if name is -, use stdin
+    if (strcmp(src_name, "-") == 0)
+    {
+#ifdef _WIN32
+        // reopen stdin in binary mode in case it wasn't, probably only windows issue
+        _setmode(_fileno(stdin),  _O_BINARY);
+#endif
+        rh->file = stdin;
+        rh->file_size = -1;
+    }
+    else {
+        const char *err = open_file(src_name, &rh->file, &rh->file_size);
+        if (err) {
+            return err;
+        }
     }
 
-    for (int i = 0; i < height; i++) {
-        memcpy(dstp, srcp, row_size);
-        dstp += dst_stride;
-        srcp += row_size;
+#ifdef RS_HAVE_PIPE_FD
+    // headers are parsed through stdio, unbuffered so that it never holds
+    // bytes past them and frames can be read from the descriptor later
+    if (rh->file_size < 0) {
+        setvbuf(rh->file, NULL, _IONBF, 0);
     }
+#endif
+    return NULL;
 }
 
 
-static inline uint32_t VS_CC
-bitor8to32(uint8_t b0, uint8_t b1, uint8_t b2, uint8_t b3)
+#ifdef RS_HAVE_PIPE_FD
+// read frames from a pipe with large read() calls and a pipe buffer that
+// holds a whole frame where the limits allow, instead of stdio and the
+// default 64KB, to cut the number of wakeups per frame
+static void open_pipe_direct(rs_hnd_t *rh, const VSAPI *vsapi)
 {
-    return ((uint32_t)b0 << 24) | ((uint32_t)b1 << 16) |
-           ((uint32_t)b2 << 8) | (uint32_t)b3;
+    int fd = fileno(rh->file);
+    int size = 1 << 26;
+    while (size > 65536 && size / 2 >= (int64_t)rh->frame_size)
+        size /= 2;
+    // unprivileged processes are limited to /proc/sys/fs/pipe-max-size
+    while (size > 65536 && fcntl(fd, F_SETPIPE_SZ, size) < 0)
+        size /= 2;
+
+    VS_LOG(mtDebug, "pipe buffer is %d bytes", fcntl(fd, F_GETPIPE_SZ));
+    rh->pipe_direct = 1;
+    rh->pipe_peek = -1;
 }
+#endif
 
 
-static void VS_CC
-write_planar_frame(const rs_hnd_t *rh, VSFrameRef **dst, const VSAPI *vsapi,
-                   VSCore *core)
+#ifdef RS_HAVE_PIPE_FD
+// fill a chunk from the pipe. a partial chunk is handed over once the pipe
+// has been idle for 100ms, so the tail of a frame isn't held back by a
+// writer that pauses. the pipe is polled so that the thread notices quit
+static size_t fill_chunk(rs_pipe_reader_t *r, uint8_t *chunk)
 {
-    uint8_t *srcp = rh->frame_buff;
-    int bps = rh->vi[0].format->bytesPerSample;
-    int row_size, height;
+    size_t done = 0;
+    while (done < r->chunk_size && !r->quit) {
+        struct pollfd pfd = { r->fd, POLLIN, 0 };
+        int ret = poll(&pfd, 1, 100);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret == 0) {
+            if (done)
+                break;
+            continue;
+        }
+        ssize_t len = ret < 0 ? -1 : read(r->fd, chunk + done, r->chunk_size - done);
+        if (len < 0 && errno == EINTR)
+            continue;
+        if (len <= 0)
+            break;
+        done += len;
+    }
+    return done;
+}
 
-    for (int i = 0, num = rh->vi[0].format->numPlanes; i < num; i++) {
-        int plane = rh->order[i];
-        row_size = vsapi->getFrameWidth(dst[0], plane) * bps;
-        row_size = (row_size + rh->row_adjust) & (~rh->row_adjust);
-        height = vsapi->getFrameHeight(dst[0], plane);
 
-        if ( ((srcp - rh->frame_buff) + row_size*height) > (int) rh->frame_size) {
-            VS_LOG(mtCritical, "write_planar_frame: buffer overflow, check format parameters");
-            return;
-        }
+static RS_THREAD_FUNC(pipe_reader_thread, arg)
+{
+    rs_pipe_reader_t *r = (rs_pipe_reader_t *)arg;
 
-        rs_bit_blt(srcp, row_size, height, dst[0], plane, vsapi);
-        srcp += row_size * height;
+    for (int i = 0; ; i = (i + 1) % r->num_chunks) {
+        rs_sem_wait(&r->free);
+        if (r->quit)
+            break;
+        r->len[i] = fill_chunk(r, r->buff + (size_t)i * r->chunk_size);
+        rs_sem_post(&r->full);
+        if (r->len[i] == 0)
+            break;
     }
 
-    if (rh->has_alpha == 0) {
-        return;
-    }
+    RS_THREAD_RETURN;
+}
 
-    dst[1] = vsapi->newVideoFrame(rh->vi[1].format, rh->vi[1].width,
-                                  rh->vi[1].height, NULL, core);
-    row_size = vsapi->getFrameWidth(dst[1], 0) * bps;
-    row_size = (row_size + rh->row_adjust) & (~rh->row_adjust);
-    height = vsapi->getFrameHeight(dst[1], 0);
-    rs_bit_blt(srcp, row_size, height, dst[1], 0, vsapi);
+
+static size_t read_pipe_reader(rs_pipe_reader_t *r, uint8_t *buff, size_t len)
+{
+    size_t done = 0;
+    while (done < len && !r->eof) {
+        if (r->cur < 0) {
+            rs_sem_wait(&r->full);
+            r->cur = r->next;
+            r->next = (r->next + 1) % r->num_chunks;
+            r->pos = 0;
+            if (r->len[r->cur] == 0) {
+                r->eof = 1;
+                break;
+            }
+        }
+        size_t left = r->len[r->cur] - r->pos;
+        size_t n = len - done < left ? len - done : left;
+        memcpy(buff + done, r->buff + (size_t)r->cur * r->chunk_size + r->pos, n);
+        r->pos += n;
+        done += n;
+        if (r->pos == r->len[r->cur]) {
+            r->cur = -1;
+            rs_sem_post(&r->free);
+        }
+    }
+    return done;
 }
 
 
-static void VS_CC
-write_nvxx_frame(const rs_hnd_t *rh, VSFrameRef **dst, const VSAPI *vsapi,
-                 VSCore *core)
+// start reading a pipe ahead of the requests, chunks the size of a frame
+static const char *open_pipe_reader(rs_hnd_t *rh, int read_ahead)
 {
-    struct uv_t {
-        uint8_t c[8];
-    };
+    rs_pipe_reader_t *r = (rs_pipe_reader_t *)calloc(1, sizeof(rs_pipe_reader_t));
+    if (!r) {
+        return "failed to allocate buffer";
+    }
+    r->fd = fileno(rh->file);
+    r->num_chunks = read_ahead;
+    r->chunk_size = rh->frame_size + rh->off_frame;
+    r->buff = (uint8_t *)malloc(r->chunk_size * read_ahead);
+    r->len = (size_t *)calloc(read_ahead, sizeof(size_t));
+    r->cur = -1;
+    if (!r->buff || !r->len) {
+        free(r->buff);
+        free(r->len);
+        free(r);
+        return "failed to allocate buffer";
+    }
 
-    uint8_t *srcp_orig = rh->frame_buff;
+    rs_sem_init(&r->free, read_ahead);
+    rs_sem_init(&r->full, 0);
+    if (rs_thread_create(&r->thread, pipe_reader_thread, r) != 0) {
+        rs_sem_destroy(&r->free);
+        rs_sem_destroy(&r->full);
+        free(r->buff);
+        free(r->len);
+        free(r);
+        return "failed to start the pipe reader";
+    }
+    rh->reader = r;
+    return NULL;
+}
 
-    int row_size = vsapi->getFrameWidth(dst[0], 0);
-    row_size = (row_size + rh->row_adjust) & (~rh->row_adjust);
-    int height = vsapi->getFrameHeight(dst[0], 0);
-    rs_bit_blt(srcp_orig, row_size, height, dst[0], 0, vsapi);
 
-    srcp_orig += row_size * height;
-    int src_stride = row_size;
-    row_size = (vsapi->getFrameWidth(dst[0], 1) + 3) >> 2;
-    height = vsapi->getFrameHeight(dst[0], 1);
+static void close_pipe_reader(rs_pipe_reader_t *r)
+{
+    r->quit = 1;
+    rs_sem_post(&r->free);
+    rs_thread_join(r->thread);
+    rs_sem_destroy(&r->free);
+    rs_sem_destroy(&r->full);
+    free(r->buff);
+    free(r->len);
+    free(r);
+}
+#endif
 
-    int dst_stride = vsapi->getStride(dst[0], 1);
-    uint8_t *dstp0_orig = vsapi->getWritePtr(dst[0], rh->order[1]);
-    uint8_t *dstp1_orig = vsapi->getWritePtr(dst[0], rh->order[2]);
 
-    for (int y = 0; y < height; y++) {
-        struct uv_t *srcp = (struct uv_t *)(srcp_orig + y * src_stride);
-        uint32_t *dstp0 = (uint32_t *)(dstp0_orig + y * dst_stride);
-        uint32_t *dstp1 = (uint32_t *)(dstp1_orig + y * dst_stride);
-        for (int x = 0; x < row_size; x++) {
-            dstp0[x] = bitor8to32(srcp[x].c[6], srcp[x].c[4], srcp[x].c[2],
-                                  srcp[x].c[0]);
-            dstp1[x] = bitor8to32(srcp[x].c[7], srcp[x].c[5], srcp[x].c[3],
-                                  srcp[x].c[1]);
+// read up to len bytes of a pipe, less only at its end
+static size_t read_pipe(rs_hnd_t *rh, uint8_t *buff, size_t len)
+{
+#ifdef RS_HAVE_PIPE_FD
+    if (rh->pipe_direct) {
+        size_t done = 0;
+        if (rh->pipe_peek >= 0 && len > 0) {
+            buff[done++] = (uint8_t)rh->pipe_peek;
+            rh->pipe_peek = -1;
+        }
+        if (rh->reader)
+            return done + read_pipe_reader(rh->reader, buff + done, len - done);
+        while (done < len) {
+            ssize_t ret = read(fileno(rh->file), buff + done, len - done);
+            if (ret < 0 && errno == EINTR)
+                continue;
+            if (ret <= 0)
+                break;
+            done += ret;
         }
+        return done;
     }
+#endif
+    return fread(buff, 1, len, rh->file);
 }
 
 
-static void VS_CC
-write_px1x_frame(const rs_hnd_t *rh, VSFrameRef **dst, const VSAPI *vsapi,
-                 VSCore *core)
+// check if a pipe has ended without losing the byte read to find out
+static int pipe_eof(rs_hnd_t *rh)
 {
-    struct uv16_t {
-        uint16_t c[2];
-    };
+#ifdef RS_HAVE_PIPE_FD
+    if (rh->pipe_direct) {
+        uint8_t c;
+        if (rh->pipe_peek < 0 && read_pipe(rh, &c, 1) == 1)
+            rh->pipe_peek = c;
+        return rh->pipe_peek < 0;
+    }
+#endif
+    int c = getc(rh->file);
+    if (c == EOF)
+        return 1;
+    ungetc(c, rh->file);
+    return 0;
+}
 
-    uint8_t *srcp_orig = rh->frame_buff;
 
-    int row_size = vsapi->getFrameWidth(dst[0], 0) << 1;
-    row_size = (row_size + rh->row_adjust) & (~rh->row_adjust);
-    int height = vsapi->getFrameHeight(dst[0], 0);
-    rs_bit_blt(srcp_orig, row_size, height, dst[0], 0, vsapi);
+// check that a source name is a numbered pattern like cap_%04d.raw,
+// with a single integer conversion and nothing else for printf to expand
+static int is_pattern(const char *name)
+{
+    const char *p = strchr(name, '%');
+    if (!p || strchr(p + 1, '%'))
+        return 0;
+    p++;
+    while (*p >= '0' && *p <= '9')
+        p++;
+    return *p == 'd';
+}
 
-    srcp_orig += row_size * height;
-    int src_stride = row_size;
-    row_size = vsapi->getFrameWidth(dst[0], 1);
-    height = vsapi->getFrameHeight(dst[0], 1);
-    int dst_stride = vsapi->getStride(dst[0], 1) >> 1;
-    uint16_t *dstp0 = (uint16_t *)vsapi->getWritePtr(dst[0], rh->order[1]);
-    uint16_t *dstp1 = (uint16_t *)vsapi->getWritePtr(dst[0], rh->order[2]);
 
-    for (int y = 0; y < height; y++) {
-        struct uv16_t *srcp_uv = (struct uv16_t *)(srcp_orig + y *src_stride);
-        for (int x = 0; x < row_size; x++) {
-            dstp0[x] = srcp_uv[x].c[0];
-            dstp1[x] = srcp_uv[x].c[1];
+// names of the files matching a numbered pattern, counting from 0 or 1
+// up to the first one that doesn't exist
+static char **expand_pattern(const char *pattern, int *count)
+{
+    char name[FILENAME_MAX];
+    char **names = NULL;
+    int capacity = 0;
+    *count = 0;
+
+    for (int i = 0; ; i++) {
+        snprintf(name, sizeof(name), pattern, i);
+        FILE *file;
+        int64_t size;
+        if (open_file(name, &file, &size) != NULL) {
+            if (i == 0)
+                continue;
+            break;
         }
-        dstp0 += dst_stride;
-        dstp1 += dst_stride;
+        fclose(file);
+
+        if (*count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            char **tmp = (char **)realloc(names, sizeof(char *) * capacity);
+            if (!tmp)
+                break;
+            names = tmp;
+        }
+        size_t len = strlen(name) + 1;
+        names[*count] = (char *)malloc(len);
+        if (!names[*count])
+            break;
+        memcpy(names[*count], name, len);
+        (*count)++;
     }
+
+    return names;
 }
 
 
-static void VS_CC
-write_packed_rgb24(const rs_hnd_t *rh, VSFrameRef **dst, const VSAPI *vsapi,
-                   VSCore *core)
+// file holding frame n. segments after the first are opened on demand and
+// the least recently used one is closed when the pool is full
+static FILE *frame_file(rs_hnd_t *rh, int n, const VSAPI *vsapi)
 {
-    struct rgb24_t {
-        uint8_t c[12];
-    };
+    int segment = rh->index_segment ? rh->index_segment[n] : 0;
+    if (segment == 0)
+        return rh->file;
+
+    rs_pool_entry_t *lru = NULL;
+    for (int i = 0; i < RS_POOL_SIZE; i++) {
+        rs_pool_entry_t *e = &rh->pool[i];
+        if (e->file && e->segment == segment) {
+            e->tick = ++rh->pool_tick;
+            return e->file;
+        }
+        if (!lru || (lru->file && (!e->file || e->tick < lru->tick)))
+            lru = e;
+    }
 
-    uint8_t *srcp_orig = rh->frame_buff;
-    int row_size = (rh->vi[0].width + 3) >> 2;
-    int height = rh->vi[0].height;
-    int src_stride = (rh->vi[0].width * 3 + rh->row_adjust) & (~rh->row_adjust);
+    if (lru->file)
+        fclose(lru->file);
+    lru->file = NULL;
 
-    uint8_t *dstp0_orig = vsapi->getWritePtr(dst[0], rh->order[0]);
-    uint8_t *dstp1_orig = vsapi->getWritePtr(dst[0], rh->order[1]);
-    uint8_t *dstp2_orig = vsapi->getWritePtr(dst[0], rh->order[2]);
-    int dst_stride = vsapi->getStride(dst[0], 0);
+    int64_t size;
+    const char *err = open_file(rh->segment_name[segment], &lru->file, &size);
+    if (err) {
+        VS_LOG(mtCritical, "%s: %s", rh->segment_name[segment], err);
+        lru->file = NULL;
+        return NULL;
+    }
+    lru->segment = segment;
+    lru->tick = ++rh->pool_tick;
+    return lru->file;
+}
 
-    for (int y = 0; y < height; y++) {
 
-        int yh = y;
-        if (rh->flip_v)
-           yh = height-y-1;
+// allocate a raw data buffer, optionally backed by huge pages. *mapped
+// receives the mapping length to pass to free_buffer, 0 if malloc was used.
+static uint8_t *alloc_buffer(size_t size, int hugepages, size_t *mapped)
+{
+    *mapped = 0;
+
+#ifndef _WIN32
+    if (hugepages) {
+        size_t length = (size + HUGE_PAGE_SIZE - 1) & ~((size_t)HUGE_PAGE_SIZE - 1);
+        void *p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+        // explicit huge pages, only available if the admin reserved them
+        p = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+        if (p == MAP_FAILED) {
+            // fall back to transparent huge pages
+            p = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_HUGEPAGE
+            if (p != MAP_FAILED)
+                madvise(p, length, MADV_HUGEPAGE);
+#endif
+        }
+        if (p != MAP_FAILED) {
+            *mapped = length;
+            return (uint8_t *)p;
+        }
+    }
+#endif
 
-        struct rgb24_t *srcp = (struct rgb24_t *)(srcp_orig + yh * src_stride);
+#ifndef _WIN32
+    // page aligned so the buffer can also be used with O_DIRECT
+    void *p;
+    return posix_memalign(&p, 4096, size) == 0 ? (uint8_t *)p : NULL;
+#else
+    return (uint8_t *)malloc(size);
+#endif
+}
 
-        uint32_t *dstp0 = (uint32_t *)(dstp0_orig + y * dst_stride);
-        uint32_t *dstp1 = (uint32_t *)(dstp1_orig + y * dst_stride);
-        uint32_t *dstp2 = (uint32_t *)(dstp2_orig + y * dst_stride);
 
-        for (int x = 0; x < row_size; x++) {
-            dstp0[x] = bitor8to32(srcp[x].c[9], srcp[x].c[6],
-                                  srcp[x].c[3], srcp[x].c[0]);
-            dstp1[x] = bitor8to32(srcp[x].c[10], srcp[x].c[7],
-                                  srcp[x].c[4], srcp[x].c[1]);
-            dstp2[x] = bitor8to32(srcp[x].c[11], srcp[x].c[8],
-                                  srcp[x].c[5], srcp[x].c[2]);
-        }
+static void free_buffer(uint8_t *buff, size_t mapped)
+{
+#ifndef _WIN32
+    if (mapped) {
+        munmap(buff, mapped);
+        return;
     }
+#endif
+    free(buff);
 }
 
 
-static void VS_CC
-write_packed_rgb48(const rs_hnd_t *rh, VSFrameRef **dst, const VSAPI *vsapi,
-                   VSCore *core)
+// anonymous temporary file for spooling a pipe, placed in TMPDIR so it
+// can be pointed at a disk rather than a tmpfs
+static FILE *open_spool_file(void)
 {
-    struct rgb48_t {
-        uint16_t c[3];
-    };
-
-    uint8_t *srcp_orig = rh->frame_buff;
-    int src_stride = (rh->vi[0].width * 6 + rh->row_adjust) & (~rh->row_adjust);
-    int width = rh->vi[0].width;
-    int height = rh->vi[0].height;
+#ifdef _WIN32
+    return tmpfile();
+#else
+    const char *dir = getenv("TMPDIR");
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/rawsource-XXXXXX", dir && *dir ? dir : "/tmp");
+    int fd = mkstemp(path);
+    if (fd < 0)
+        return NULL;
+    unlink(path);
+    FILE *file = fdopen(fd, "w+b");
+    if (!file)
+        close(fd);
+    return file;
+#endif
+}
 
-    uint16_t *dstp0 = (uint16_t *)vsapi->getWritePtr(dst[0], rh->order[0]);
-    uint16_t *dstp1 = (uint16_t *)vsapi->getWritePtr(dst[0], rh->order[1]);
-    uint16_t *dstp2 = (uint16_t *)vsapi->getWritePtr(dst[0], rh->order[2]);
-    int stride = vsapi->getStride(dst[0], 0) >> 1;;
 
-    for (int y = 0; y < height; y++) {
+// positional read that doesn't disturb other readers of rh->file
+static int read_at(rs_hnd_t *rh, uint8_t *buff, size_t len, int64_t pos)
+{
+#ifdef _WIN32
+    rs_mutex_lock(&rh->lock);
+    int ret = rs_fseek(rh->file, pos, SEEK_SET) != 0 ||
+              fread(buff, 1, len, rh->file) != len;
+    rs_mutex_unlock(&rh->lock);
+    return -ret;
+#else
+    int fd = fileno(rh->file);
+    while (len > 0) {
+        ssize_t ret = pread(fd, buff, len, pos);
+        if (ret <= 0)
+            return -1;
+        buff += ret;
+        pos += ret;
+        len -= ret;
+    }
+    return 0;
+#endif
+}
 
-        int yh = y;
-        if (rh->flip_v)
-           yh = height-y-1;
 
-        struct rgb48_t *srcp = (struct rgb48_t *)(srcp_orig + yh * src_stride);
+// CRC32C (Castagnoli), slicing-by-8 in software or the SSE4.2 crc32
+// instruction when the cpu has it. selected in VapourSynthPluginInit
+static uint32_t crc32c_table[8][256];
 
-        for (int x = 0; x < width; x++) {
-            dstp0[x] = srcp[x].c[0];
-            dstp1[x] = srcp[x].c[1];
-            dstp2[x] = srcp[x].c[2];
-        }
-        dstp0 += stride;
-        dstp1 += stride;
-        dstp2 += stride;
+static void crc32c_init_table(void)
+{
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int k = 0; k < 8; k++)
+            crc = crc & 1 ? (crc >> 1) ^ 0x82F63B78 : crc >> 1;
+        crc32c_table[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int t = 1; t < 8; t++)
+            crc32c_table[t][i] = (crc32c_table[t - 1][i] >> 8) ^
+                                 crc32c_table[0][crc32c_table[t - 1][i] & 0xFF];
     }
 }
 
 
-static void VS_CC
-write_packed_rgb32(const rs_hnd_t *rh, VSFrameRef **dst, const VSAPI *vsapi,
-                   VSCore *core)
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t *p, size_t len)
 {
-    struct rgb32_t {
-        uint8_t c[16];
-    };
+    for (; len > 0 && ((uintptr_t)p & 7); len--)
+        crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *p++) & 0xFF];
+
+    for (; len >= 8; len -= 8, p += 8) {
+        uint32_t lo = crc ^ ((uint32_t)p[0] | (uint32_t)p[1] << 8 |
+                             (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+        crc = crc32c_table[7][lo & 0xFF] ^ crc32c_table[6][(lo >> 8) & 0xFF] ^
+              crc32c_table[5][(lo >> 16) & 0xFF] ^ crc32c_table[4][lo >> 24] ^
+              crc32c_table[3][p[4]] ^ crc32c_table[2][p[5]] ^
+              crc32c_table[1][p[6]] ^ crc32c_table[0][p[7]];
+    }
 
-    uint8_t *srcp_orig = rh->frame_buff;
-    int src_stride = ((rh->vi[0].width << 2) + rh->row_adjust) & (~rh->row_adjust);
-    int row_size = (rh->vi[0].width + 3) >> 2;
-    int height = rh->vi[0].height;
+    while (len--)
+        crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *p++) & 0xFF];
+    return crc;
+}
 
-    const int *order = rh->order;
 
-    dst[1] = vsapi->newVideoFrame(rh->vi[1].format, rh->vi[1].width,
-                                  rh->vi[1].height, NULL, core);
+#ifdef RS_HAVE_CRC32C_HW
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const uint8_t *p, size_t len)
+{
+    for (; len > 0 && ((uintptr_t)p & 7); len--)
+        crc = _mm_crc32_u8(crc, *p++);
+#ifdef __x86_64__
+    uint64_t crc64 = crc;
+    for (; len >= 8; len -= 8, p += 8)
+        crc64 = _mm_crc32_u64(crc64, *(const uint64_t *)p);
+    crc = (uint32_t)crc64;
+#else
+    for (; len >= 4; len -= 4, p += 4)
+        crc = _mm_crc32_u32(crc, *(const uint32_t *)p);
+#endif
+    while (len--)
+        crc = _mm_crc32_u8(crc, *p++);
+    return crc;
+}
+#endif
 
-    uint32_t *dstp[4];
-    for (int i = 0; i < 3; i++) {
-        dstp[i] = (uint32_t *)vsapi->getWritePtr(dst[0], i);
-    }
-    dstp[3] = (uint32_t *)vsapi->getWritePtr(dst[1], 0);
-    int dst_stride = vsapi->getStride(dst[0], 0) >> 2;
 
+static uint32_t (*crc32c_update)(uint32_t, const uint8_t *, size_t) = crc32c_sw;
 
-    for (int y = 0; y < height; y++) {
+static void crc32c_init(void)
+{
+    crc32c_init_table();
+#ifdef RS_HAVE_CRC32C_HW
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2"))
+        crc32c_update = crc32c_hw;
+#endif
+}
 
-        int yh = y;
-        if (rh->flip_v)
-           yh = height-y-1;
 
-        struct rgb32_t *srcp = (struct rgb32_t *)(srcp_orig + yh * src_stride);
+// crc of len bytes at p, continuing from a previous result (0 to start)
+static inline uint32_t crc32c(uint32_t crc, const uint8_t *p, size_t len)
+{
+    return ~crc32c_update(~crc, p, len);
+}
 
-        for (int x = 0; x < row_size; x++) {
-            *(dstp[order[0]] + x) = bitor8to32(srcp[x].c[12], srcp[x].c[8],
-                                               srcp[x].c[4], srcp[x].c[0]);
-            *(dstp[order[1]] + x) = bitor8to32(srcp[x].c[13], srcp[x].c[9],
-                                               srcp[x].c[5], srcp[x].c[1]);
-            *(dstp[order[2]] + x) = bitor8to32(srcp[x].c[14], srcp[x].c[10],
-                                               srcp[x].c[6], srcp[x].c[2]);
-            *(dstp[order[3]] + x) = bitor8to32(srcp[x].c[15], srcp[x].c[11],
-                                               srcp[x].c[7], srcp[x].c[3]);
-        }
-        for (int i = 0; i < 4; i++)
-            dstp[i] += dst_stride;
-    }
-}
 
-
-static void VS_CC
-write_packed_yuv422(const rs_hnd_t *rh, VSFrameRef **dst, const VSAPI *vsapi,
-                    VSCore *core)
+// sidecar manifest: the CRC32C of every frame in order, one per line as
+// hex digits. empty lines and lines starting with # are skipped
+static const char *load_manifest(rs_hnd_t *rh, const char *name)
 {
-    struct packed422_t {
-        uint8_t c[4];
-    };
-
-    uint8_t *srcp_orig = rh->frame_buff;
-    int src_stride = ((rh->vi[0].width << 1) + rh->row_adjust) & (~rh->row_adjust);
-    int width = rh->vi[0].width >> 1;
-    int height = rh->vi[0].height;
-    int o0 = rh->order[0];
-    int o1 = rh->order[1];
-    int o2 = rh->order[2];
-    int o3 = rh->order[3];
-
-    uint8_t *dstp[3];
-    int padding[3];
-    for (int i = 0; i < 3; i++) {
-        dstp[i] = vsapi->getWritePtr(dst[0], i);
-        padding[i] = vsapi->getStride(dst[0], i) - vsapi->getFrameWidth(dst[0], i);
+    FILE *file = fopen(name, "r");
+    if (!file) {
+        return "failed to open manifest";
     }
 
-    for (int y = 0; y < height; y++) {
-        struct packed422_t *srcp = (struct packed422_t *)(srcp_orig + y * src_stride);
-        for (int x = 0; x < width; x++) {
-            *(dstp[o0]++) = srcp[x].c[0];
-            *(dstp[o1]++) = srcp[x].c[1];
-            *(dstp[o2]++) = srcp[x].c[2];
-            *(dstp[o3]++) = srcp[x].c[3];
+    char line[256];
+    int capacity = 0;
+    const char *err = NULL;
+    while (fgets(line, sizeof(line), file)) {
+        char *p = line;
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (*p == '#' || *p == '\n' || *p == '\r' || *p == 0)
+            continue;
+
+        char *end;
+        unsigned long crc = strtoul(p, &end, 16);
+        if (end == p || crc > 0xFFFFFFFFUL) {
+            err = "invalid line in manifest";
+            break;
         }
-        dstp[0] += padding[0];
-        dstp[1] += padding[1];
-        dstp[2] += padding[2];
+
+        if (rh->manifest_frames == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            uint32_t *tmp = (uint32_t *)realloc(rh->manifest, sizeof(uint32_t) * capacity);
+            if (!tmp) {
+                err = "failed to allocate buffer";
+                break;
+            }
+            rh->manifest = tmp;
+        }
+        rh->manifest[rh->manifest_frames++] = (uint32_t)crc;
     }
+
+    fclose(file);
+    return err;
 }
 
 
-static int VS_CC create_index(rs_hnd_t *rh)
+// start measuring the planes of fmt, half floats aren't measured
+static int stats_init(rs_stats_t *stats, const VSFormat *fmt, int histogram)
 {
-    int num_frames = rh->vi[0].numFrames;
-
-    int64_t *index = (int64_t *)malloc(sizeof(int64_t) * num_frames);
-    if (!index) {
-        return -1;
-    }
-
-    int off_frame = rh->off_frame;
-    uint32_t frame_size = rh->frame_size;
-    int64_t pos = rh->off_header;
-    for (int i = 0; i < num_frames; i++) {
-        pos += off_frame;
-        index[i] = pos;
-        pos += frame_size;
+    for (int p = 0; p < fmt->numPlanes; p++) {
+        rs_stats_t *st = &stats[p];
+        memset(st, 0, sizeof(*st));
+        if (fmt->sampleType == stFloat && fmt->bytesPerSample != 4)
+            continue;
+        st->bytes = fmt->bytesPerSample;
+        st->min = UINT32_MAX;
+        st->fmin = FLT_MAX;
+        st->fmax = -FLT_MAX;
+        if (histogram && fmt->sampleType == stInteger) {
+            st->hist = (uint32_t *)calloc((size_t)1 << (st->bytes * 8), sizeof(uint32_t));
+            if (!st->hist)
+                return -1;
+        }
     }
-
-    rh->index = index;
     return 0;
 }
 
 
-static inline const char * VS_CC get_format(char *ctag)
+static void stats_free(rs_stats_t *stats, int num_planes)
 {
-    const struct {
-        char *tag;
-        char *format;
-    } table[] = {
-        { "420",      "YUV420P8"  },
-        { "420jpeg",  "YUV420P8"  },
-        { "420mpeg2", "YUV420P8"  },
-        { "420paldv", "YUV420P8"  },
-        { "420p9",    "YUV420P9"  },
-        { "420p10",   "YUV420P10" },
-        { "420p16",   "YUV420P16" },
-        { "410",      "YUV410P8"  },
-        { "411",      "YUV411P8"  },
-        { "422",      "YUV422P8"  },
-        { "422p9",    "YUV422P9"  },
-        { "422p10",   "YUV422P10" },
-        { "422p16",   "YUV422P16" },
-        { "440",      "YUV440P8"  },
-        { "444",      "YUV444P8"  },
-        { "444p9",    "YUV444P9"  },
-        { "444p10",   "YUV444P10" },
-        { "444p16",   "YUV444P16" },
-        { "444alpha", "YUV444P8A" },
-        { "444p32",   "YUV444PS"  },
-        { "mono",     "GRAY"      },
-        { "mono16",   "GRAY16"    },
-        { "mono32",   "GRAYS"     },
-        { ctag,       ""  }
-    };
-
-    int i = 0;
-    while (strcasecmp(ctag, table[i].tag) != 0)
-        i++;
-
-    return table[i].format;
+    for (int p = 0; p < num_planes; p++)
+        free(stats[p].hist);
 }
 
 
-#define PARSE_HEADER(cond, ...) {\
-    i += 2;\
-    sscanf(buff + i, __VA_ARGS__);\
-    if (cond) {\
-        return -1;\
-    }\
-}
-static int VS_CC check_y4m(rs_hnd_t *rh, const VSAPI *vsapi)
+static void stats_row(rs_stats_t *st, const uint8_t *row, int width)
 {
-    const char *stream_header = "YUV4MPEG2" + sizeof(rh->magic);
-    const char *frame_header = "FRAME\n";
-    size_t sh_length = strlen(stream_header);
-    size_t fh_length = strlen(frame_header);
-    char buff[256] = { 0 };
-    char ctag[32] = { 0 };
-
-    if (buff != fgets(buff, sizeof(buff), rh->file))
-        return 1;
+    int x = 0;
+    st->count += width;
+
+    if (st->bytes == 4) {
+        const float *r = (const float *)row;
+        float mn = st->fmin, mx = st->fmax;
+        double sum = 0;
+        for (; x < width; x++) {
+            mn = r[x] < mn ? r[x] : mn;
+            mx = r[x] > mx ? r[x] : mx;
+            sum += r[x];
+        }
+        st->fmin = mn;
+        st->fmax = mx;
+        st->fsum += sum;
+        return;
+    }
 
-    if (strncmp(buff, stream_header, sh_length) != 0)
-        return 1;
+    // min, max and sum come out of the histogram when there is one
+    if (st->hist) {
+        if (st->bytes == 1) {
+            for (; x < width; x++)
+                st->hist[row[x]]++;
+        } else {
+            const uint16_t *r = (const uint16_t *)row;
+            for (; x < width; x++)
+                st->hist[r[x]]++;
+        }
+        return;
+    }
 
-    size_t i;
-    for (i = sh_length; buff[i] != '\n'; i++) {
-        if (!strncmp(buff + i, " W", 2)) {
-            PARSE_HEADER(rh->vi[0].width < 1, "%d", &rh->vi[0].width);
+    uint32_t mn = st->min, mx = st->max;
+    uint64_t sum = 0;
+
+    if (st->bytes == 1) {
+#ifdef __SSE2__
+        if (width >= 16) {
+            __m128i vmin = _mm_set1_epi8(-1), vmax = _mm_setzero_si128();
+            __m128i vsum = _mm_setzero_si128(), zero = _mm_setzero_si128();
+            for (; x + 16 <= width; x += 16) {
+                __m128i v = _mm_loadu_si128((const __m128i *)(row + x));
+                vmin = _mm_min_epu8(vmin, v);
+                vmax = _mm_max_epu8(vmax, v);
+                vsum = _mm_add_epi64(vsum, _mm_sad_epu8(v, zero));
+            }
+            uint8_t lo[16], hi[16];
+            uint64_t s[2];
+            _mm_storeu_si128((__m128i *)lo, vmin);
+            _mm_storeu_si128((__m128i *)hi, vmax);
+            _mm_storeu_si128((__m128i *)s, vsum);
+            for (int i = 0; i < 16; i++) {
+                mn = lo[i] < mn ? lo[i] : mn;
+                mx = hi[i] > mx ? hi[i] : mx;
+            }
+            sum = s[0] + s[1];
         }
-        if (!strncmp(buff + i, " H", 2)) {
-            PARSE_HEADER(rh->vi[0].height < 1, "%d", &rh->vi[0].height);
+#endif
+        for (; x < width; x++) {
+            mn = row[x] < mn ? row[x] : mn;
+            mx = row[x] > mx ? row[x] : mx;
+            sum += row[x];
         }
-        if (!strncmp(buff + i, " F", 2)) {
-            i += 2;
-            sscanf(buff + i, "%"SCNi64":%"SCNi64, &rh->vi[0].fpsNum, &rh->vi[0].fpsDen);
-            if (rh->vi[0].fpsNum < 1 || rh->vi[0].fpsDen < 1) {
-                return -1;
+    } else {
+        const uint16_t *r = (const uint16_t *)row;
+#ifdef __SSE2__
+        // no unsigned 16-bit min/max before SSE4.1, compare with the sign flipped
+        if (width >= 8) {
+            __m128i bias = _mm_set1_epi16(-0x8000), zero = _mm_setzero_si128();
+            __m128i vmin = _mm_set1_epi16(0x7fff), vmax = _mm_set1_epi16(-0x8000);
+            while (x + 8 <= width) {
+                // 32768 samples are 8192 per 32-bit lane before they are folded,
+                // which can't overflow
+                __m128i vsum = _mm_setzero_si128();
+                int end = x + 32768 < width ? x + 32768 : width;
+                for (; x + 8 <= end; x += 8) {
+                    __m128i v = _mm_loadu_si128((const __m128i *)(r + x));
+                    __m128i b = _mm_xor_si128(v, bias);
+                    vmin = _mm_min_epi16(vmin, b);
+                    vmax = _mm_max_epi16(vmax, b);
+                    vsum = _mm_add_epi32(vsum, _mm_unpacklo_epi16(v, zero));
+                    vsum = _mm_add_epi32(vsum, _mm_unpackhi_epi16(v, zero));
+                }
+                uint32_t s[4];
+                _mm_storeu_si128((__m128i *)s, vsum);
+                sum += (uint64_t)s[0] + s[1] + s[2] + s[3];
             }
-        }
-        if (!strncmp(buff + i, " A", 2)) {
-            i += 2;
-            sscanf(buff + i, "%d:%d", &rh->sar_num, &rh->sar_den);
-            if (rh->sar_num < 0 || rh->sar_den < 0) {
-                return -1;
+            uint16_t lo[8], hi[8];
+            _mm_storeu_si128((__m128i *)lo, _mm_xor_si128(vmin, bias));
+            _mm_storeu_si128((__m128i *)hi, _mm_xor_si128(vmax, bias));
+            for (int i = 0; i < 8; i++) {
+                mn = lo[i] < mn ? lo[i] : mn;
+                mx = hi[i] > mx ? hi[i] : mx;
             }
         }
-        if (!strncmp(buff + i, " I", 2)) {
-            i += 2;
-            if (buff[i] == 'm') {
-                return -2;
-            }
+#endif
+        for (; x < width; x++) {
+            mn = r[x] < mn ? r[x] : mn;
+            mx = r[x] > mx ? r[x] : mx;
+            sum += r[x];
         }
-        if (!strncmp(buff + i, " C", 2)) {
-            i += 2;
-            sscanf(buff + i, "%s", ctag);
-            strcpy(rh->src_format, get_format(ctag));
+    }
 
-            if (strlen(rh->src_format) == 0)
-                VS_LOG(mtWarning, "check_y4m: unknown frame format in y4m header: %s", ctag);
+    st->min = mn;
+    st->max = mx;
+    st->sum += sum;
+}
+
+
+// RawStatsMin/Max/Sum/Average have one element per plane, Average is
+// scaled to 0-1 for integer formats like std.PlaneStats does.
+// RawStatsHistogram0.. hold the histogram of every plane
+static void stats_set_props(rs_stats_t *stats, const VSFormat *fmt, VSMap *props,
+                            const VSAPI *vsapi)
+{
+    for (int p = 0; p < fmt->numPlanes; p++) {
+        rs_stats_t *st = &stats[p];
+        if (!st->bytes || !st->count)
+            continue;
+
+        if (st->bytes == 4) {
+            vsapi->propSetFloat(props, "RawStatsMin", st->fmin, paAppend);
+            vsapi->propSetFloat(props, "RawStatsMax", st->fmax, paAppend);
+            vsapi->propSetFloat(props, "RawStatsSum", st->fsum, paAppend);
+            vsapi->propSetFloat(props, "RawStatsAverage", st->fsum / st->count, paAppend);
+            continue;
         }
-        if (i == sizeof buff - 1) {
-            return -2;
+
+        if (st->hist) {
+            // the histogram covers bitsPerSample, stray high values still
+            // count towards min, max and sum
+            int bins = 1 << fmt->bitsPerSample;
+            int64_t *h = (int64_t *)malloc(sizeof(int64_t) * bins);
+            st->min = UINT32_MAX;
+            st->max = 0;
+            for (int i = 0, n = 1 << (st->bytes * 8); i < n; i++) {
+                if (st->hist[i]) {
+                    st->min = st->min < (uint32_t)i ? st->min : (uint32_t)i;
+                    st->max = i;
+                    st->sum += (uint64_t)st->hist[i] * i;
+                }
+                if (h && i < bins)
+                    h[i] = st->hist[i];
+            }
+            if (h) {
+                char name[32];
+                snprintf(name, sizeof(name), "RawStatsHistogram%d", p);
+                vsapi->propSetIntArray(props, name, h, bins);
+                free(h);
+            }
         }
+
+        double peak = (double)((1 << fmt->bitsPerSample) - 1);
+        vsapi->propSetInt(props, "RawStatsMin", st->min, paAppend);
+        vsapi->propSetInt(props, "RawStatsMax", st->max, paAppend);
+        vsapi->propSetInt(props, "RawStatsSum", (int64_t)st->sum, paAppend);
+        vsapi->propSetFloat(props, "RawStatsAverage", st->sum / (st->count * peak), paAppend);
     }
+}
 
-    rh->off_header = (int)++i;
-    rh->off_frame = (int)fh_length;
 
-    if (strlen(rh->src_format) == 0) {
-        VS_LOG(mtWarning, "check_y4m: assuming the format is YUV420P8");
-        strcpy(rh->src_format, "YUV420P8");
+static inline float half_to_float(uint16_t h)
+{
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exp = (h >> 10) & 0x1f, man = h & 0x3ff, bits;
+    if (exp == 0x1f) {
+        bits = sign | 0x7f800000 | (man << 13);
+    } else if (exp) {
+        bits = sign | ((exp + 112) << 23) | (man << 13);
+    } else {
+        // zero and subnormals, man * 2^-24
+        float f = man * (1.0f / 16777216.0f);
+        return sign ? -f : f;
     }
-
-    rh->row_adjust = 1;
-    return 0;
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
 }
-#undef PARSE_HEADER
 
 
-static inline int32_t abs_i(int32_t i)
+// widen the x halves at the start of row to floats, from the right
+static void half_to_float_row_c(uint8_t *row, int x)
 {
-    return i < 0 ? -i : i;
+    const uint16_t *in = (const uint16_t *)row;
+    float *out = (float *)row;
+    for (; x > 0; x--)
+        out[x - 1] = half_to_float(in[x - 1]);
 }
 
 
-static int check_bmp(rs_hnd_t *rh, const VSAPI *vsapi)
+#ifdef RS_HAVE_F16C
+__attribute__((target("f16c")))
+static void half_to_float_row_f16c(uint8_t *row, int x)
 {
-    uint32_t offset_data;
-    bmp_info_header_t info = { 0 };
+    const uint16_t *in = (const uint16_t *)row;
+    float *out = (float *)row;
+    for (; x & 7; x--)
+        out[x - 1] = half_to_float(in[x - 1]);
+    for (x -= 8; x >= 0; x -= 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + x));
+        __m128 hi = _mm_cvtph_ps(_mm_unpackhi_epi64(v, v));
+        _mm_storeu_ps(out + x, _mm_cvtph_ps(v));
+        _mm_storeu_ps(out + x + 4, hi);
+    }
+}
+#endif
 
-    char head[10 - sizeof(rh->magic) ];
 
-    if (sizeof(head) != fread(head, 1, sizeof(head), rh->file))
-        return 1;
+static void (*half_to_float_row)(uint8_t *, int) = half_to_float_row_c;
 
-    if (sizeof(uint32_t) != fread(&offset_data, 1, sizeof(uint32_t), rh->file))
-        return 1;
+static void half_init(void)
+{
+#ifdef RS_HAVE_F16C
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("f16c"))
+        half_to_float_row = half_to_float_row_f16c;
+#endif
+}
 
-    if (sizeof(bmp_info_header_t) != fread(&info, 1, sizeof(bmp_info_header_t), rh->file))
-        return 1;
 
-    if (info.num_planes != 1 || info.fourcc != 0 ||
-        (info.bits_per_pixel != 24 && info.bits_per_pixel != 32))
-        return 1;
+// convert the samples of a row from the source format to out_format in place.
+// wider samples are written from the right, so none is overwritten before it
+// has been read
+static void convert_row(const rs_rows_t *rows, int plane, uint8_t *row, int width)
+{
+    int x = width;
 
-    rh->vi[0].width = abs_i(info.width);
-    rh->vi[0].height = abs_i(info.height);
-    strcpy(rh->src_format, info.bits_per_pixel == 24 ? "BGR" : "BGRA");
-    rh->off_header = 0;
-    rh->off_frame  = offset_data;
-    rh->row_adjust = 4;
-    rh->flip_v = info.height > 0;   // +height means bmp is bottom-up, must be flipped
-    rh->skip_first_frame_header = 1;// don't re-read the header when the first frame is requested
+    if (rows->half) {
+        half_to_float_row(row, width);
+        return;
+    }
 
-    VS_LOG(mtDebug, "check_bmp: width=%d height=%d bpp=%d align=%d offset=%d flip_v=%d",
-        (int)info.width, (int)info.height, (int)info.bits_per_pixel,
-        rh->row_adjust, rh->off_header, rh->flip_v);
+    if (rows->out_bytes == 4) {
+        float *out = (float *)row;
+        float scale = rows->scale[plane], offset = rows->offset[plane];
+        if (rows->in_bytes == 1) {
+            for (; x & 15; x--)
+                out[x - 1] = row[x - 1] * scale + offset;
+#ifdef __SSE2__
+            __m128i zero = _mm_setzero_si128();
+            __m128 s = _mm_set1_ps(scale), o = _mm_set1_ps(offset);
+            for (x -= 16; x >= 0; x -= 16) {
+                __m128i v = _mm_loadu_si128((const __m128i *)(row + x));
+                __m128i lo = _mm_unpacklo_epi8(v, zero), hi = _mm_unpackhi_epi8(v, zero);
+                __m128i w[4] = { _mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero),
+                                 _mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero) };
+                for (int i = 0; i < 4; i++)
+                    _mm_storeu_ps(out + x + i * 4,
+                                  _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(w[i]), s), o));
+            }
+#else
+            for (; x > 0; x--)
+                out[x - 1] = row[x - 1] * scale + offset;
+#endif
+        } else {
+            const uint16_t *in = (const uint16_t *)row;
+            for (; x & 7; x--)
+                out[x - 1] = in[x - 1] * scale + offset;
+#ifdef __SSE2__
+            __m128i zero = _mm_setzero_si128();
+            __m128 s = _mm_set1_ps(scale), o = _mm_set1_ps(offset);
+            for (x -= 8; x >= 0; x -= 8) {
+                __m128i v = _mm_loadu_si128((const __m128i *)(in + x));
+                __m128 lo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero));
+                __m128 hi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero));
+                _mm_storeu_ps(out + x, _mm_add_ps(_mm_mul_ps(lo, s), o));
+                _mm_storeu_ps(out + x + 4, _mm_add_ps(_mm_mul_ps(hi, s), o));
+            }
+#else
+            for (; x > 0; x--)
+                out[x - 1] = in[x - 1] * scale + offset;
+#endif
+        }
+        return;
+    }
 
-    return 0;
+    if (rows->in_bytes == 1) {
+        // 8 bits to 9~16
+        uint16_t *out = (uint16_t *)row;
+        int shift = rows->shift;
+        for (; x & 15; x--)
+            out[x - 1] = (uint16_t)(row[x - 1] << shift);
+#ifdef __SSE2__
+        __m128i zero = _mm_setzero_si128(), count = _mm_cvtsi32_si128(shift);
+        for (x -= 16; x >= 0; x -= 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(row + x));
+            _mm_storeu_si128((__m128i *)(out + x),
+                             _mm_sll_epi16(_mm_unpacklo_epi8(v, zero), count));
+            _mm_storeu_si128((__m128i *)(out + x + 8),
+                             _mm_sll_epi16(_mm_unpackhi_epi8(v, zero), count));
+        }
+#else
+        for (; x > 0; x--)
+            out[x - 1] = (uint16_t)(row[x - 1] << shift);
+#endif
+        return;
+    }
+
+    // 9~16 bits to 9~16, e.g. P010 to YUV420P10
+    uint16_t *in = (uint16_t *)row;
+    x = 0;
+#ifdef __SSE2__
+    __m128i count = _mm_cvtsi32_si128(rows->shift < 0 ? -rows->shift : rows->shift);
+    for (; x + 8 <= width; x += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + x));
+        v = rows->shift < 0 ? _mm_srl_epi16(v, count) : _mm_sll_epi16(v, count);
+        _mm_storeu_si128((__m128i *)(in + x), v);
+    }
+#endif
+    for (; x < width; x++)
+        in[x] = (uint16_t)(rows->shift < 0 ? in[x] >> -rows->shift : in[x] << rows->shift);
 }
 
 
-static int check_header(rs_hnd_t *rh, const VSAPI *vsapi)
+// set up the row work for frames in out_format. output_planes: the rows
+// are those of the output frame, which may be a single plane
+static void rows_init(rs_rows_t *rows, const rs_hnd_t *rh, rs_stats_t *stats,
+                      int output_planes)
 {
-    // read file magic to see what the file type is, if there is
-    // no recognized type then it is raw data
-    if (sizeof(rh->magic) != fread(rh->magic, 1, sizeof(rh->magic), rh->file))
-    {
-        VS_LOG(mtFatal, "check_header: fail to read file magic");
-        return 0;
-    }
+    memset(rows, 0, sizeof(*rows));
+    rows->stats = stats;
 
-    if (strncmp("BM", rh->magic, 2) == 0)
-        return check_bmp(rh, vsapi);
+    const VSFormat *in = rh->vi[0].format, *out = rh->out_format;
+    if (in->id == out->id)
+        return;
 
-    if (strncmp("YU", rh->magic, 2) == 0)
-        return check_y4m(rh, vsapi);
+    rows->in_bytes = in->bytesPerSample;
+    rows->out_bytes = out->bytesPerSample;
+    rows->shift = out->bitsPerSample - in->bitsPerSample;
+    rows->half = in->sampleType == stFloat;
+    if (rows->half)
+        return;
 
-    // these bytes are part of the actual frame and need to be handled
-    rh->write_magic = 1;
+    // float is 0~1, and -0.5~0.5 for chroma
+    float peak = (float)((1 << in->bitsPerSample) - 1);
+    for (int p = 0; p < 3; p++) {
+        int plane = output_planes && rh->plane >= 0 ? rh->plane : p;
+        rows->scale[p] = 1.0f / peak;
+        if (in->colorFamily == cmYUV && plane > 0)
+            rows->offset[p] = -(float)(1 << (in->bitsPerSample - 1)) / peak;
+    }
+}
 
-    return 1;
+
+// done by the converters on every row right after writing it
+static inline void
+finish_row(const rs_rows_t *rows, VSFrameRef *f, int plane, int y, const VSAPI *vsapi)
+{
+    uint8_t *row = vsapi->getWritePtr(f, plane) + (size_t)y * vsapi->getStride(f, plane);
+    int width = vsapi->getFrameWidth(f, plane);
+
+    if (rows->in_bytes)
+        convert_row(rows, plane, row, width);
+    if (rows->stats && rows->stats[plane].bytes)
+        stats_row(&rows->stats[plane], row, width);
 }
 
 
-static const char * VS_CC check_args(rs_hnd_t *rh, vs_args_t *va)
+// the output rows a converter writes, a stripe of them when the frame is
+// streamed through a small buffer instead of being read whole
+static inline int stripe_begin(const rs_rows_t *rows)
 {
-    const VSAPI* vsapi = va->vsapi;
+    return rows ? rows->y_begin : 0;
+}
 
-    const struct {
-        char *format_name;
-        int subsample_h;
-        int subsample_v;
-        int num_planes;
-        int bytes_per_row_sample;
-        int has_alpha;
-        int order[4];
-        VSPresetFormat vsformat;
-        func_write_frame func;
-    } table[] = {
-        { "YUV9",      4, 4, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV410P8,  write_planar_frame  },
-        { "YUV410P",   4, 4, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV410P8,  write_planar_frame  },
-        { "YUV410P8",  4, 4, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV410P8,  write_planar_frame  },
-        { "YVU9",      4, 4, 3, 1, 0, { 0, 2, 1, 9 }, pfYUV410P8,  write_planar_frame  },
-
-        { "YUV411P",   4, 1, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV411P8,  write_planar_frame  },
-        { "YUV411P8",  4, 1, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV411P8,  write_planar_frame  },
-        { "YV411",     4, 1, 3, 1, 0, { 0, 2, 1, 9 }, pfYUV411P8,  write_planar_frame  },
-
-        { "i420",      2, 2, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV420P8,  write_planar_frame  },
-        { "IYUV",      2, 2, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV420P8,  write_planar_frame  },
-        { "YUV420P",   2, 2, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV420P8,  write_planar_frame  },
-        { "YUV420P8",  2, 2, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV420P8,  write_planar_frame  },
-        { "YV12",      2, 2, 3, 1, 0, { 0, 2, 1, 9 }, pfYUV420P8,  write_planar_frame  },
-        { "YUV420P9",  2, 2, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV420P9,  write_planar_frame  },
-        { "YUV420P10", 2, 2, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV420P10, write_planar_frame  },
-        { "YUV420P16", 2, 2, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV420P16, write_planar_frame  },
-
-        { "NV12",      2, 2, 2, 1, 0, { 0, 1, 2, 9 }, pfYUV420P8,  write_nvxx_frame    },
-        { "NV21",      2, 2, 2, 1, 0, { 0, 2, 1, 9 }, pfYUV420P8,  write_nvxx_frame    },
-
-        { "P010",      2, 2, 2, 2, 0, { 0, 1, 2, 9 }, pfYUV420P16, write_px1x_frame    },
-        { "P016",      2, 2, 2, 2, 0, { 0, 1, 2, 9 }, pfYUV420P16, write_px1x_frame    },
-
-        { "YUY2",      2, 1, 1, 2, 0, { 0, 1, 0, 2 }, pfYUV422P8,  write_packed_yuv422 },
-        { "YUYV",      2, 1, 1, 2, 0, { 0, 1, 0, 2 }, pfYUV422P8,  write_packed_yuv422 },
-        { "YUYV422",   2, 1, 1, 2, 0, { 0, 1, 0, 2 }, pfYUV422P8,  write_packed_yuv422 },
-        { "YVYU",      2, 1, 1, 2, 0, { 0, 2, 0, 1 }, pfYUV422P8,  write_packed_yuv422 },
-        { "YVYU422",   2, 1, 1, 2, 0, { 0, 2, 0, 1 }, pfYUV422P8,  write_packed_yuv422 },
-        { "UYVY",      2, 1, 1, 2, 0, { 1, 0, 2, 0 }, pfYUV422P8,  write_packed_yuv422 },
-        { "UYVY422",   2, 1, 1, 2, 0, { 1, 0, 2, 0 }, pfYUV422P8,  write_packed_yuv422 },
-        { "VYUY",      2, 1, 1, 2, 0, { 2, 0, 1, 0 }, pfYUV422P8,  write_packed_yuv422 },
-        { "VYUY422",   2, 1, 1, 2, 0, { 2, 0, 1, 0 }, pfYUV422P8,  write_packed_yuv422 },
-
-        { "P210",      2, 1, 2, 2, 0, { 0, 1, 2, 9 }, pfYUV422P16, write_px1x_frame    },
-        { "P216",      2, 1, 2, 2, 0, { 0, 1, 2, 9 }, pfYUV422P16, write_px1x_frame    },
-
-        { "i422",      2, 1, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV422P8,  write_planar_frame  },
-        { "YUV422P",   2, 1, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV422P8,  write_planar_frame  },
-        { "YUV422P8",  2, 1, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV422P8,  write_planar_frame  },
-        { "YV16",      2, 1, 3, 1, 0, { 0, 2, 1, 9 }, pfYUV422P8,  write_planar_frame  },
-        { "YUV422P9",  2, 1, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV422P9,  write_planar_frame  },
-        { "YUV422P10", 2, 1, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV422P10, write_planar_frame  },
-        { "YUV422P16", 2, 1, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV422P16, write_planar_frame  },
-
-
-        { "YUV440P",   1, 2, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV440P8,  write_planar_frame  },
-        { "YUV440P8",  1, 2, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV440P8,  write_planar_frame  },
-
-        { "Y8",        1, 1, 1, 1, 0, { 0, 9, 9, 9 }, pfGray8,     write_planar_frame  },
-        { "Y800",      1, 1, 1, 1, 0, { 0, 9, 9, 9 }, pfGray8,     write_planar_frame  },
-        { "GRAY",      1, 1, 1, 1, 0, { 0, 9, 9, 9 }, pfGray8,     write_planar_frame  },
-        { "GRAY16",    1, 1, 1, 2, 0, { 0, 9, 9, 9 }, pfGray16,    write_planar_frame  },
-        { "GRAYH",     1, 1, 1, 2, 0, { 0, 9, 9, 9 }, pfGrayH,     write_planar_frame  },
-        { "GRAYS",     1, 1, 1, 4, 0, { 0, 9, 9, 9 }, pfGrayS,     write_planar_frame  },
-
-        { "i444",      1, 1, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV444P8,  write_planar_frame  },
-        { "YUV444P",   1, 1, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV444P8,  write_planar_frame  },
-        { "YUV444P8",  1, 1, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV444P8,  write_planar_frame  },
-        { "YV24",      1, 1, 3, 1, 0, { 0, 2, 1, 9 }, pfYUV444P8,  write_planar_frame  },
-        { "YUV444P9",  1, 1, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV444P9,  write_planar_frame  },
-        { "YUV444P10", 1, 1, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV444P10, write_planar_frame  },
-        { "YUV444P16", 1, 1, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV444P16, write_planar_frame  },
-        { "YUV444PS",  1, 1, 3, 4, 0, { 0, 1, 2, 9 }, pfYUV444PS,  write_planar_frame  },
-        { "YUV444P8A", 1, 1, 4, 1, 1, { 0, 1, 2, 3 }, pfYUV444P8,  write_planar_frame  },
-
-        { "BGR",       1, 1, 1, 3, 0, { 2, 1, 0, 9 }, pfRGB24,     write_packed_rgb24  },
-        { "BGR24",     1, 1, 1, 3, 0, { 2, 1, 0, 9 }, pfRGB24,     write_packed_rgb24  },
-        { "RGB",       1, 1, 1, 3, 0, { 0, 1, 2, 9 }, pfRGB24,     write_packed_rgb24  },
-        { "RGB24",     1, 1, 1, 3, 0, { 0, 1, 2, 9 }, pfRGB24,     write_packed_rgb24  },
-
-        { "BGRA",      1, 1, 1, 4, 1, { 2, 1, 0, 3 }, pfRGB24,     write_packed_rgb32  },
-        { "ABGR",      1, 1, 1, 4, 1, { 3, 2, 1, 0 }, pfRGB24,     write_packed_rgb32  },
-        { "RGBA",      1, 1, 1, 4, 1, { 0, 1, 2, 3 }, pfRGB24,     write_packed_rgb32  },
-        { "ARGB",      1, 1, 1, 4, 1, { 3, 0, 1, 2 }, pfRGB24,     write_packed_rgb32  },
-        { "AYUV",      1, 1, 1, 4, 1, { 3, 0, 1, 2 }, pfYUV444P8,  write_packed_rgb32  },
-
-        { "GBRP8",     1, 1, 3, 1, 0, { 1, 2, 0, 9 }, pfRGB24,     write_planar_frame  },
-        { "GBRP",      1, 1, 3, 1, 0, { 1, 2, 0, 9 }, pfRGB24,     write_planar_frame  },
-        { "RGBP",      1, 1, 3, 1, 0, { 0, 1, 2, 9 }, pfRGB24,     write_planar_frame  },
-        { "RGBP8",     1, 1, 3, 1, 0, { 0, 1, 2, 9 }, pfRGB24,     write_planar_frame  },
-
-        { "GBRP9",     1, 1, 3, 2, 0, { 1, 2, 0, 9 }, pfRGB27,     write_planar_frame  },
-        { "RGBP9",     1, 1, 3, 2, 0, { 0, 1, 2, 9 }, pfRGB27,     write_planar_frame  },
-        { "GBRP10",    1, 1, 3, 2, 0, { 1, 2, 0, 9 }, pfRGB30,     write_planar_frame  },
-        { "RGBP10",    1, 1, 3, 2, 0, { 0, 1, 2, 9 }, pfRGB30,     write_planar_frame  },
-        { "GBRP16",    1, 1, 3, 2, 0, { 1, 2, 0, 9 }, pfRGB48,     write_planar_frame  },
-        { "RGBP16",    1, 1, 3, 2, 0, { 0, 1, 2, 9 }, pfRGB48,     write_planar_frame  },
-        { "BGR48",     1, 1, 3, 2, 0, { 2, 1, 0, 3 }, pfRGB48,     write_packed_rgb48  },
-        { "RGB48",     1, 1, 3, 2, 0, { 0, 1, 2, 3 }, pfRGB48,     write_packed_rgb48  },
-        { rh->src_format, 0 }
-    };
 
-    int i = 0;
-    while (strcasecmp(rh->src_format, table[i].format_name) != 0)
-        i++;
+static inline int stripe_end(const rs_rows_t *rows, int height)
+{
+    return rows && rows->y_end ? rows->y_end : height;
+}
 
-    if (table[i].vsformat == 0)
-        return "unsupported format";
 
-    if (rh->vi[0].width % table[i].subsample_h != 0)
-        return "invalid width was specified";
+// source row yh in src, which starts at row src_y of the frame when streamed
+static inline const uint8_t *
+stripe_src(const rs_rows_t *rows, const uint8_t *src, int yh, int src_stride)
+{
+    return src + (size_t)(yh - (rows ? rows->src_y : 0)) * src_stride;
+}
 
-    if (rh->vi[0].height % table[i].subsample_v != 0)
-        return "invalid height was specified";
 
-    int frame_size = 0;
-    for (int p = 0; p < table[i].num_planes; p++) {
-        int width_plane =
-            (rh->vi[0].width / (p ? table[i].subsample_h : 1)) << (table[i].num_planes == 2 && p ? 1 : 0);
-        int height_plane = rh->vi[0].height / (p ? table[i].subsample_v : 1);
-        int row_size_plane =
-            (width_plane * table[i].bytes_per_row_sample + rh->row_adjust) & (~rh->row_adjust);
-        frame_size += row_size_plane * height_plane;
+// the same for a whole frame, for paths that read straight into the planes
+static void finish_frame(const rs_rows_t *rows, VSFrameRef *f, const VSAPI *vsapi)
+{
+    const VSFormat *fmt = vsapi->getFrameFormat(f);
+    for (int p = 0; p < fmt->numPlanes; p++) {
+        for (int y = 0, h = vsapi->getFrameHeight(f, p); y < h; y++)
+            finish_row(rows, f, p, y, vsapi);
     }
+}
 
-    rh->frame_size = frame_size;
-    rh->vi[0].format = va->vsapi->getFormatPreset(table[i].vsformat, va->core);
-    memcpy(rh->order, table[i].order, sizeof(int) * 4);
-    rh->write_frame = table[i].func;
-    rh->has_alpha = table[i].has_alpha;
 
-    VS_LOG(mtDebug, "check_args: src_format=%s dst_format=%s size=%dx%d alpha=%d frame_size=%d off_header=%d off_frame=%d",
-        table[i].format_name, &rh->vi[0].format->name, rh->vi[0].width, rh->vi[0].height, rh->has_alpha,
-        frame_size, rh->off_header, rh->off_frame);
+static void VS_CC
+rs_bit_blt(const uint8_t *srcp, int row_size, int height, VSFrameRef *dst, int plane,
+           const rs_rows_t *rows, const VSAPI *vsapi)
+{
+    uint8_t *dstp = vsapi->getWritePtr(dst, plane);
+    int dst_stride = vsapi->getStride(dst, plane);
+
+    if (row_size == dst_stride && !rows) {
+        memcpy(dstp, srcp, (size_t)row_size * height);
+        return;
+    }
+
+    for (int i = 0; i < height; i++) {
+        memcpy(dstp, srcp, row_size);
+        if (rows)
+            finish_row(rows, dst, plane, i, vsapi);
+        dstp += dst_stride;
+        srcp += row_size;
+    }
+}
+
+
+static inline uint32_t VS_CC
+bitor8to32(uint8_t b0, uint8_t b1, uint8_t b2, uint8_t b3)
+{
+    return ((uint32_t)b0 << 24) | ((uint32_t)b1 << 16) |
+           ((uint32_t)b2 << 8) | (uint32_t)b3;
+}
+
+
+static void VS_CC
+write_planar_frame(const rs_hnd_t *rh, const uint8_t *src, VSFrameRef **dst,
+                   const rs_rows_t *rows, const VSAPI *vsapi, VSCore *core)
+{
+    const uint8_t *srcp = src;
+    int bps = rh->vi[0].format->bytesPerSample;
+    int row_size, height;
+
+    for (int i = 0, num = rh->vi[0].format->numPlanes; i < num; i++) {
+        int plane = rh->order[i];
+        row_size = vsapi->getFrameWidth(dst[0], plane) * bps;
+        row_size = (row_size + rh->row_adjust) & (~rh->row_adjust);
+        height = vsapi->getFrameHeight(dst[0], plane);
+
+        if ((uint64_t)(srcp - src) + (uint64_t)row_size * height > rh->frame_size) {
+            VS_LOG(mtCritical, "write_planar_frame: buffer overflow, check format parameters");
+            return;
+        }
+
+        rs_bit_blt(srcp, row_size, height, dst[0], plane, rows, vsapi);
+        srcp += (size_t)row_size * height;
+    }
+
+    if (rh->has_alpha == 0) {
+        return;
+    }
+
+    dst[1] = vsapi->newVideoFrame(rh->vi[1].format, rh->vi[1].width,
+                                  rh->vi[1].height, NULL, core);
+    row_size = vsapi->getFrameWidth(dst[1], 0) * bps;
+    row_size = (row_size + rh->row_adjust) & (~rh->row_adjust);
+    height = vsapi->getFrameHeight(dst[1], 0);
+    rs_bit_blt(srcp, row_size, height, dst[1], 0, NULL, vsapi);
+}
+
+
+#ifdef RS_HAVE_PREADV
+// preadv until every iovec is filled, IOV_MAX entries at a time
+static int preadv_all(int fd, struct iovec *iov, int count, int64_t pos)
+{
+    while (count > 0) {
+        ssize_t ret = preadv(fd, iov, count < IOV_MAX ? count : IOV_MAX, pos);
+        if (ret <= 0)
+            return -1;
+        pos += ret;
+
+        // skip fully read entries, then trim a partially read one
+        while (count > 0 && (size_t)ret >= iov->iov_len) {
+            ret -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (uint8_t *)iov->iov_base + ret;
+            iov->iov_len -= ret;
+        }
+    }
+
+    return 0;
+}
+
+
+static int VS_CC
+planar_iov_count(const rs_hnd_t *rh)
+{
+    const VSFormat *fmt = rh->vi[0].format;
+    int count = rh->vi[0].height * (1 + rh->has_alpha);
+
+    if (fmt->numPlanes > 1)
+        count += (rh->vi[0].height >> fmt->subSamplingH) * 2;
+
+    return count;
+}
+
+
+// read a planar frame with one iovec per plane (or per row when the source
+// row size differs from the destination stride) straight into the output
+// frame, bypassing both stdio and rh->frame_buff
+static int VS_CC
+read_planar_direct(rs_hnd_t *rh, FILE *file, int64_t pos, VSFrameRef **dst,
+                   const VSAPI *vsapi, VSCore *core)
+{
+    struct iovec *iov = rh->iov;
+    int bps = rh->vi[0].format->bytesPerSample;
+    int num_planes = rh->vi[0].format->numPlanes;
+    int64_t total = 0;
+    int count = 0;
+
+    if (rh->has_alpha)
+        dst[1] = vsapi->newVideoFrame(rh->vi[1].format, rh->vi[1].width,
+                                      rh->vi[1].height, NULL, core);
+
+    for (int i = 0; i < num_planes + rh->has_alpha; i++) {
+        VSFrameRef *frame = i < num_planes ? dst[0] : dst[1];
+        int plane = i < num_planes ? rh->order[i] : 0;
+        int row_size = vsapi->getFrameWidth(frame, plane) * bps;
+        row_size = (row_size + rh->row_adjust) & (~rh->row_adjust);
+        int height = vsapi->getFrameHeight(frame, plane);
+        int dst_stride = vsapi->getStride(frame, plane);
+        uint8_t *dstp = vsapi->getWritePtr(frame, plane);
+
+        total += (int64_t)row_size * height;
+        if (total > rh->frame_size || row_size > dst_stride) {
+            VS_LOG(mtCritical, "read_planar_direct: buffer overflow, check format parameters");
+            return -1;
+        }
+
+        if (row_size == dst_stride) {
+            iov[count].iov_base = dstp;
+            iov[count].iov_len = (size_t)row_size * height;
+            count++;
+            continue;
+        }
+
+        for (int y = 0; y < height; y++) {
+            iov[count].iov_base = dstp;
+            iov[count].iov_len = row_size;
+            dstp += dst_stride;
+            count++;
+        }
+    }
+
+    return preadv_all(fileno(file), iov, count, pos);
+}
+
+
+// crc of the raw bytes read_planar_direct put into the frame, in file order
+static uint32_t VS_CC
+crc_planar_frame(const rs_hnd_t *rh, VSFrameRef **dst, const VSAPI *vsapi)
+{
+    int bps = rh->vi[0].format->bytesPerSample;
+    int num_planes = rh->vi[0].format->numPlanes;
+    uint32_t crc = 0;
+
+    for (int i = 0; i < num_planes + rh->has_alpha; i++) {
+        VSFrameRef *frame = i < num_planes ? dst[0] : dst[1];
+        int plane = i < num_planes ? rh->order[i] : 0;
+        int row_size = vsapi->getFrameWidth(frame, plane) * bps;
+        row_size = (row_size + rh->row_adjust) & (~rh->row_adjust);
+        int height = vsapi->getFrameHeight(frame, plane);
+        int stride = vsapi->getStride(frame, plane);
+        const uint8_t *srcp = vsapi->getReadPtr(frame, plane);
+
+        if (row_size == stride) {
+            crc = crc32c(crc, srcp, (size_t)row_size * height);
+            continue;
+        }
+        for (int y = 0; y < height; y++) {
+            crc = crc32c(crc, srcp, row_size);
+            srcp += stride;
+        }
+    }
+
+    return crc;
+}
+
+
+typedef struct {
+    rs_hnd_t *rh;
+    int i;              // plane in src_fmt order, the alpha plane last
+    int64_t frame;      // position of the frame in the plane files
+    VSFrameRef **dst;
+    const VSAPI *vsapi;
+    int ret;
+} rs_plane_read_t;
+
+
+// read one plane of a frame from its own file into the output frame. the
+// planes use separate parts of rh->iov, so they can be read at the same time
+static int read_plane_file(rs_plane_read_t *pr)
+{
+    rs_hnd_t *rh = pr->rh;
+    const VSAPI *vsapi = pr->vsapi;
+    int num_planes = rh->vi[0].format->numPlanes;
+    int bps = rh->vi[0].format->bytesPerSample;
+    VSFrameRef *frame = pr->i < num_planes ? pr->dst[0] : pr->dst[1];
+    int plane = pr->i < num_planes ? rh->order[pr->i] : 0;
+    int row_size = vsapi->getFrameWidth(frame, plane) * bps;
+    row_size = (row_size + rh->row_adjust) & (~rh->row_adjust);
+    int height = vsapi->getFrameHeight(frame, plane);
+    int dst_stride = vsapi->getStride(frame, plane);
+    uint8_t *dstp = vsapi->getWritePtr(frame, plane);
+    int64_t pos = rh->off_header +
+                  pr->frame * (rh->off_frame + (int64_t)rh->plane_size[pr->i]) + rh->off_frame;
+
+    struct iovec *iov = rh->iov;
+    for (int i = 0; i < pr->i; i++)
+        iov += i < num_planes && rh->order[i] ? rh->vi[0].height >> rh->vi[0].format->subSamplingH
+                                              : rh->vi[0].height;
+
+    if (row_size == dst_stride) {
+        iov[0].iov_base = dstp;
+        iov[0].iov_len = (size_t)row_size * height;
+        return preadv_all(fileno(rh->plane_file[pr->i]), iov, 1, pos);
+    }
+    if (row_size > dst_stride)
+        return -1;
+    for (int y = 0; y < height; y++) {
+        iov[y].iov_base = dstp;
+        iov[y].iov_len = row_size;
+        dstp += dst_stride;
+    }
+    return preadv_all(fileno(rh->plane_file[pr->i]), iov, height, pos);
+}
+
+
+static RS_THREAD_FUNC(plane_read_thread, arg)
+{
+    rs_plane_read_t *pr = (rs_plane_read_t *)arg;
+    pr->ret = read_plane_file(pr);
+    RS_THREAD_RETURN;
+}
+
+
+// plane_files: the planes after the first are read by threads of their own
+// while this one reads the first, so the files are read concurrently
+static int VS_CC
+read_plane_files(rs_hnd_t *rh, int64_t frame, VSFrameRef **dst, const VSAPI *vsapi,
+                 VSCore *core)
+{
+    int count = rh->vi[0].format->numPlanes + rh->has_alpha;
+    rs_plane_read_t pr[4];
+    rs_thread_t thread[4];
+    int started[4] = { 0 };
+
+    if (rh->has_alpha)
+        dst[1] = vsapi->newVideoFrame(rh->vi[1].format, rh->vi[1].width,
+                                      rh->vi[1].height, NULL, core);
+
+    for (int i = count - 1; i >= 0; i--) {
+        rs_plane_read_t p = { rh, i, frame, dst, vsapi, 0 };
+        pr[i] = p;
+        if (i > 0)
+            started[i] = rs_thread_create(&thread[i], plane_read_thread, &pr[i]) == 0;
+        if (!started[i])
+            pr[i].ret = read_plane_file(&pr[i]);
+    }
+
+    int ret = 0;
+    for (int i = 0; i < count; i++) {
+        if (started[i])
+            rs_thread_join(thread[i]);
+        ret |= pr[i].ret;
+    }
+    return ret;
+}
+
+
+#define SPAN_GAP_MAX (64 << 10)
+
+typedef struct {
+    int fd;
+    struct iovec *iov;
+    int count;
+    int max;
+    int64_t pos;        // file offset of iov[0]
+    int64_t end;        // file offset just after the last queued byte
+    uint8_t *scratch;   // SPAN_GAP_MAX bytes
+} rs_span_reader_t;
+
+
+static int span_flush(rs_span_reader_t *r)
+{
+    int ret = preadv_all(r->fd, r->iov, r->count, r->pos);
+    r->count = 0;
+    return ret;
+}
+
+
+// queue len bytes at file offset pos for dst. a gap of up to SPAN_GAP_MAX
+// from the previous span is read through into the scratch buffer, which
+// costs less than another system call; wider gaps are skipped
+static int span_add(rs_span_reader_t *r, int64_t pos, uint8_t *dst, size_t len)
+{
+    if (r->count > 0 &&
+        (pos < r->end || pos - r->end > SPAN_GAP_MAX || r->count + 2 > r->max)) {
+        if (span_flush(r) != 0)
+            return -1;
+    }
+    if (r->count == 0)
+        r->pos = r->end = pos;
+
+    if (pos > r->end) {
+        r->iov[r->count].iov_base = r->scratch;
+        r->iov[r->count].iov_len = (size_t)(pos - r->end);
+        r->count++;
+    }
+    r->iov[r->count].iov_base = dst;
+    r->iov[r->count].iov_len = len;
+    r->count++;
+    r->end = pos + len;
+    return 0;
+}
+
+
+// read only the region of a planar or semi-planar frame, the crop rectangle
+// of the planes being output. planar rows land in the output planes,
+// interleaved chroma goes through rh->frame_buff
+static int VS_CC
+read_region(rs_hnd_t *rh, FILE *file, int64_t pos, VSFrameRef **dst,
+            const VSAPI *vsapi, VSCore *core)
+{
+    const VSFormat *fmt = rh->vi[0].format;
+    int bps = fmt->bytesPerSample;
+    int semi_planar = rh->write_frame != write_planar_frame;
+    int num_planes = semi_planar ? 2 : fmt->numPlanes + rh->has_alpha;
+    rs_span_reader_t r = { fileno(file), rh->iov, 0, rh->span_iov_max, 0, 0, rh->span_scratch };
+
+    if (rh->has_alpha)
+        dst[1] = vsapi->newVideoFrame(rh->vi[1].format, rh->crop_width,
+                                      rh->crop_height, NULL, core);
+
+    for (int i = 0; i < num_planes; i++) {
+        // geometry of the i-th plane in the file
+        int ssw = i > 0 && i < 3 ? fmt->subSamplingW : 0;
+        int ssh = i > 0 && i < 3 ? fmt->subSamplingH : 0;
+        int samples = semi_planar && i ? 2 : 1;
+        int row_size = (rh->vi[0].width >> ssw) * samples * bps;
+        row_size = (row_size + rh->row_adjust) & (~rh->row_adjust);
+        int offset = (rh->crop_left >> ssw) * samples * bps;
+        int width = (rh->crop_width >> ssw) * samples * bps;
+        int top = rh->crop_top >> ssh;
+        int height = rh->crop_height >> ssh;
+        int64_t row = pos + (int64_t)row_size * top + offset;
+        pos += (int64_t)row_size * (rh->vi[0].height >> ssh);
+
+        // planes that aren't output are skipped on disk
+        uint8_t *dstp;
+        int dst_stride;
+        if (semi_planar) {
+            if (rh->plane >= 0 && (rh->plane == 0) != (i == 0))
+                continue;
+            dstp = i ? rh->frame_buff : vsapi->getWritePtr(dst[0], 0);
+            dst_stride = i ? width : vsapi->getStride(dst[0], 0);
+        } else if (i < fmt->numPlanes) {
+            if (rh->plane >= 0 && rh->plane != rh->order[i])
+                continue;
+            int plane = rh->plane >= 0 ? 0 : rh->order[i];
+            dstp = vsapi->getWritePtr(dst[0], plane);
+            dst_stride = vsapi->getStride(dst[0], plane);
+        } else {
+            dstp = vsapi->getWritePtr(dst[1], 0);
+            dst_stride = vsapi->getStride(dst[1], 0);
+        }
+
+        for (int y = 0; y < height; y++) {
+            if (span_add(&r, row, dstp, width) != 0)
+                return -1;
+            row += row_size;
+            dstp += dst_stride;
+        }
+    }
+    if (r.count > 0 && span_flush(&r) != 0)
+        return -1;
+
+    if (!semi_planar || rh->plane == 0)
+        return 0;
+
+    // split the interleaved chroma rows into the output planes
+    uint8_t *dstp[2] = { NULL, NULL };
+    if (rh->plane < 0) {
+        dstp[0] = vsapi->getWritePtr(dst[0], rh->order[1]);
+        dstp[1] = vsapi->getWritePtr(dst[0], rh->order[2]);
+    } else {
+        dstp[rh->order[1] == rh->plane ? 0 : 1] = vsapi->getWritePtr(dst[0], 0);
+    }
+    int dst_stride = vsapi->getStride(dst[0], rh->plane < 0 ? 1 : 0);
+    int width = rh->crop_width >> fmt->subSamplingW;
+    int height = rh->crop_height >> fmt->subSamplingH;
+
+    for (int c = 0; c < 2; c++) {
+        if (!dstp[c])
+            continue;
+        const uint8_t *srcp = rh->frame_buff;
+        for (int y = 0; y < height; y++) {
+            if (bps == 1) {
+                for (int x = 0; x < width; x++)
+                    dstp[c][x] = srcp[2 * x + c];
+            } else {
+                const uint16_t *src16 = (const uint16_t *)srcp;
+                uint16_t *dst16 = (uint16_t *)dstp[c];
+                for (int x = 0; x < width; x++)
+                    dst16[x] = src16[2 * x + c];
+            }
+            srcp += width * 2 * bps;
+            dstp[c] += dst_stride;
+        }
+    }
+
+    return 0;
+}
+#endif
+
+
+static void VS_CC
+write_nvxx_frame(const rs_hnd_t *rh, const uint8_t *src, VSFrameRef **dst,
+                 const rs_rows_t *rows, const VSAPI *vsapi, VSCore *core)
+{
+    struct uv_t {
+        uint8_t c[8];
+    };
+
+    const uint8_t *srcp_orig = src;
+
+    int row_size = vsapi->getFrameWidth(dst[0], 0);
+    row_size = (row_size + rh->row_adjust) & (~rh->row_adjust);
+    int height = vsapi->getFrameHeight(dst[0], 0);
+    rs_bit_blt(srcp_orig, row_size, height, dst[0], 0, rows, vsapi);
+
+    srcp_orig += (size_t)row_size * height;
+    int src_stride = row_size;
+    row_size = (vsapi->getFrameWidth(dst[0], 1) + 3) >> 2;
+    height = vsapi->getFrameHeight(dst[0], 1);
+
+    int dst_stride = vsapi->getStride(dst[0], 1);
+    uint8_t *dstp0_orig = vsapi->getWritePtr(dst[0], rh->order[1]);
+    uint8_t *dstp1_orig = vsapi->getWritePtr(dst[0], rh->order[2]);
+
+    for (int y = 0; y < height; y++) {
+        struct uv_t *srcp = (struct uv_t *)(srcp_orig + (size_t)y * src_stride);
+        uint32_t *dstp0 = (uint32_t *)(dstp0_orig + (size_t)y * dst_stride);
+        uint32_t *dstp1 = (uint32_t *)(dstp1_orig + (size_t)y * dst_stride);
+        for (int x = 0; x < row_size; x++) {
+            dstp0[x] = bitor8to32(srcp[x].c[6], srcp[x].c[4], srcp[x].c[2],
+                                  srcp[x].c[0]);
+            dstp1[x] = bitor8to32(srcp[x].c[7], srcp[x].c[5], srcp[x].c[3],
+                                  srcp[x].c[1]);
+        }
+        if (rows) {
+            finish_row(rows, dst[0], 1, y, vsapi);
+            finish_row(rows, dst[0], 2, y, vsapi);
+        }
+    }
+}
+
+
+static void VS_CC
+write_px1x_frame(const rs_hnd_t *rh, const uint8_t *src, VSFrameRef **dst,
+                 const rs_rows_t *rows, const VSAPI *vsapi, VSCore *core)
+{
+    struct uv16_t {
+        uint16_t c[2];
+    };
+
+    const uint8_t *srcp_orig = src;
+
+    int row_size = vsapi->getFrameWidth(dst[0], 0) << 1;
+    row_size = (row_size + rh->row_adjust) & (~rh->row_adjust);
+    int height = vsapi->getFrameHeight(dst[0], 0);
+    rs_bit_blt(srcp_orig, row_size, height, dst[0], 0, rows, vsapi);
+
+    srcp_orig += (size_t)row_size * height;
+    int src_stride = row_size;
+    row_size = vsapi->getFrameWidth(dst[0], 1);
+    height = vsapi->getFrameHeight(dst[0], 1);
+    int dst_stride = vsapi->getStride(dst[0], 1) >> 1;
+    uint16_t *dstp0 = (uint16_t *)vsapi->getWritePtr(dst[0], rh->order[1]);
+    uint16_t *dstp1 = (uint16_t *)vsapi->getWritePtr(dst[0], rh->order[2]);
+
+    for (int y = 0; y < height; y++) {
+        struct uv16_t *srcp_uv = (struct uv16_t *)(srcp_orig + (size_t)y * src_stride);
+        for (int x = 0; x < row_size; x++) {
+            dstp0[x] = srcp_uv[x].c[0];
+            dstp1[x] = srcp_uv[x].c[1];
+        }
+        if (rows) {
+            finish_row(rows, dst[0], 1, y, vsapi);
+            finish_row(rows, dst[0], 2, y, vsapi);
+        }
+        dstp0 += dst_stride;
+        dstp1 += dst_stride;
+    }
+}
+
+
+static void VS_CC
+write_packed_rgb24(const rs_hnd_t *rh, const uint8_t *src, VSFrameRef **dst,
+                   const rs_rows_t *rows, const VSAPI *vsapi, VSCore *core)
+{
+    struct rgb24_t {
+        uint8_t c[12];
+    };
+
+    const uint8_t *srcp_orig = src;
+    int row_size = (rh->vi[0].width + 3) >> 2;
+    int height = rh->vi[0].height;
+    int src_stride = (rh->vi[0].width * 3 + rh->row_adjust) & (~rh->row_adjust);
+
+    uint8_t *dstp0_orig = vsapi->getWritePtr(dst[0], rh->order[0]);
+    uint8_t *dstp1_orig = vsapi->getWritePtr(dst[0], rh->order[1]);
+    uint8_t *dstp2_orig = vsapi->getWritePtr(dst[0], rh->order[2]);
+    int dst_stride = vsapi->getStride(dst[0], 0);
+
+    for (int y = stripe_begin(rows), y_end = stripe_end(rows, height); y < y_end; y++) {
+
+        int yh = y;
+        if (rh->flip_v)
+           yh = height-y-1;
+
+        struct rgb24_t *srcp = (struct rgb24_t *)stripe_src(rows, srcp_orig, yh, src_stride);
+
+        uint32_t *dstp0 = (uint32_t *)(dstp0_orig + (size_t)y * dst_stride);
+        uint32_t *dstp1 = (uint32_t *)(dstp1_orig + (size_t)y * dst_stride);
+        uint32_t *dstp2 = (uint32_t *)(dstp2_orig + (size_t)y * dst_stride);
+
+        for (int x = 0; x < row_size; x++) {
+            dstp0[x] = bitor8to32(srcp[x].c[9], srcp[x].c[6],
+                                  srcp[x].c[3], srcp[x].c[0]);
+            dstp1[x] = bitor8to32(srcp[x].c[10], srcp[x].c[7],
+                                  srcp[x].c[4], srcp[x].c[1]);
+            dstp2[x] = bitor8to32(srcp[x].c[11], srcp[x].c[8],
+                                  srcp[x].c[5], srcp[x].c[2]);
+        }
+        for (int p = 0; rows && p < 3; p++)
+            finish_row(rows, dst[0], p, y, vsapi);
+    }
+}
+
+
+static void VS_CC
+write_packed_rgb48(const rs_hnd_t *rh, const uint8_t *src, VSFrameRef **dst,
+                   const rs_rows_t *rows, const VSAPI *vsapi, VSCore *core)
+{
+    struct rgb48_t {
+        uint16_t c[3];
+    };
+
+    const uint8_t *srcp_orig = src;
+    int src_stride = (rh->vi[0].width * 6 + rh->row_adjust) & (~rh->row_adjust);
+    int width = rh->vi[0].width;
+    int height = rh->vi[0].height;
+
+    int stride = vsapi->getStride(dst[0], 0) >> 1;
+    int y = stripe_begin(rows);
+    uint16_t *dstp0 = (uint16_t *)vsapi->getWritePtr(dst[0], rh->order[0]) + (size_t)y * stride;
+    uint16_t *dstp1 = (uint16_t *)vsapi->getWritePtr(dst[0], rh->order[1]) + (size_t)y * stride;
+    uint16_t *dstp2 = (uint16_t *)vsapi->getWritePtr(dst[0], rh->order[2]) + (size_t)y * stride;
+
+    for (int y_end = stripe_end(rows, height); y < y_end; y++) {
+
+        int yh = y;
+        if (rh->flip_v)
+           yh = height-y-1;
+
+        struct rgb48_t *srcp = (struct rgb48_t *)stripe_src(rows, srcp_orig, yh, src_stride);
+
+        for (int x = 0; x < width; x++) {
+            dstp0[x] = srcp[x].c[0];
+            dstp1[x] = srcp[x].c[1];
+            dstp2[x] = srcp[x].c[2];
+        }
+        for (int p = 0; rows && p < 3; p++)
+            finish_row(rows, dst[0], p, y, vsapi);
+        dstp0 += stride;
+        dstp1 += stride;
+        dstp2 += stride;
+    }
+}
+
+
+static void VS_CC
+write_packed_rgb32(const rs_hnd_t *rh, const uint8_t *src, VSFrameRef **dst,
+                   const rs_rows_t *rows, const VSAPI *vsapi, VSCore *core)
+{
+    struct rgb32_t {
+        uint8_t c[16];
+    };
+
+    const uint8_t *srcp_orig = src;
+    int src_stride = ((rh->vi[0].width << 2) + rh->row_adjust) & (~rh->row_adjust);
+    int row_size = (rh->vi[0].width + 3) >> 2;
+    int height = rh->vi[0].height;
+
+    const int *order = rh->order;
+
+    // the first stripe of a streamed frame creates the alpha frame
+    if (!dst[1])
+        dst[1] = vsapi->newVideoFrame(rh->vi[1].format, rh->vi[1].width,
+                                      rh->vi[1].height, NULL, core);
+
+    int y = stripe_begin(rows);
+    uint32_t *dstp[4];
+    int dst_stride[4];
+    for (int i = 0; i < 4; i++) {
+        VSFrameRef *f = i < 3 ? dst[0] : dst[1];
+        dst_stride[i] = vsapi->getStride(f, 0) >> 2;
+        dstp[i] = (uint32_t *)vsapi->getWritePtr(f, i < 3 ? i : 0) + (size_t)y * dst_stride[i];
+    }
+
+    for (int y_end = stripe_end(rows, height); y < y_end; y++) {
+
+        int yh = y;
+        if (rh->flip_v)
+           yh = height-y-1;
+
+        struct rgb32_t *srcp = (struct rgb32_t *)stripe_src(rows, srcp_orig, yh, src_stride);
+
+        for (int x = 0; x < row_size; x++) {
+            *(dstp[order[0]] + x) = bitor8to32(srcp[x].c[12], srcp[x].c[8],
+                                               srcp[x].c[4], srcp[x].c[0]);
+            *(dstp[order[1]] + x) = bitor8to32(srcp[x].c[13], srcp[x].c[9],
+                                               srcp[x].c[5], srcp[x].c[1]);
+            *(dstp[order[2]] + x) = bitor8to32(srcp[x].c[14], srcp[x].c[10],
+                                               srcp[x].c[6], srcp[x].c[2]);
+            *(dstp[order[3]] + x) = bitor8to32(srcp[x].c[15], srcp[x].c[11],
+                                               srcp[x].c[7], srcp[x].c[3]);
+        }
+        for (int p = 0; rows && p < 3; p++)
+            finish_row(rows, dst[0], p, y, vsapi);
+        for (int i = 0; i < 4; i++)
+            dstp[i] += dst_stride[i];
+    }
+}
+
+
+static void VS_CC
+write_packed_yuv422(const rs_hnd_t *rh, const uint8_t *src, VSFrameRef **dst,
+                    const rs_rows_t *rows, const VSAPI *vsapi, VSCore *core)
+{
+    struct packed422_t {
+        uint8_t c[4];
+    };
+
+    const uint8_t *srcp_orig = src;
+    int src_stride = ((rh->vi[0].width << 1) + rh->row_adjust) & (~rh->row_adjust);
+    int width = rh->vi[0].width >> 1;
+    int height = rh->vi[0].height;
+    int o0 = rh->order[0];
+    int o1 = rh->order[1];
+    int o2 = rh->order[2];
+    int o3 = rh->order[3];
+
+    int y = stripe_begin(rows);
+    uint8_t *dstp[3];
+    int padding[3];
+    for (int i = 0; i < 3; i++) {
+        dstp[i] = vsapi->getWritePtr(dst[0], i) + (size_t)y * vsapi->getStride(dst[0], i);
+        padding[i] = vsapi->getStride(dst[0], i) - vsapi->getFrameWidth(dst[0], i);
+    }
+
+    for (int y_end = stripe_end(rows, height); y < y_end; y++) {
+        struct packed422_t *srcp = (struct packed422_t *)stripe_src(rows, srcp_orig, y, src_stride);
+        for (int x = 0; x < width; x++) {
+            *(dstp[o0]++) = srcp[x].c[0];
+            *(dstp[o1]++) = srcp[x].c[1];
+            *(dstp[o2]++) = srcp[x].c[2];
+            *(dstp[o3]++) = srcp[x].c[3];
+        }
+        for (int p = 0; rows && p < 3; p++)
+            finish_row(rows, dst[0], p, y, vsapi);
+        dstp[0] += padding[0];
+        dstp[1] += padding[1];
+        dstp[2] += padding[2];
+    }
+}
+
+
+// YUYV with 16-bit samples, Y210 and Y216. luma is in the even words, order
+// gives the planes of the odd ones. Y210 keeps its 10 bits in the high bits
+// of each word like P010, so it is output as 16-bit
+static void VS_CC
+write_packed_yuv422_16(const rs_hnd_t *rh, const uint8_t *src, VSFrameRef **dst,
+                       const rs_rows_t *rows, const VSAPI *vsapi, VSCore *core)
+{
+    int width = rh->vi[0].width >> 1;
+    int height = rh->vi[0].height;
+    int src_stride = ((rh->vi[0].width << 2) + rh->row_adjust) & (~rh->row_adjust);
+
+    for (int y = stripe_begin(rows), y_end = stripe_end(rows, height); y < y_end; y++) {
+        const uint16_t *srcp = (const uint16_t *)stripe_src(rows, src, y, src_stride);
+        uint16_t *dstp[3];
+        for (int i = 0; i < 3; i++)
+            dstp[i] = (uint16_t *)(vsapi->getWritePtr(dst[0], i) +
+                                   (size_t)y * vsapi->getStride(dst[0], i));
+        uint16_t *dstc0 = dstp[rh->order[1]];
+        uint16_t *dstc1 = dstp[rh->order[3]];
+
+        int x = 0;
+#ifdef __SSE2__
+        // 8 groups of 2 pixels: gather the luma of each register in its low
+        // half and the chroma pairs in its high half, then split the chroma
+        for (; x + 8 <= width; x += 8) {
+            const __m128i *p = (const __m128i *)(srcp + 4 * x);
+            __m128i w[4];
+            for (int i = 0; i < 4; i++) {
+                __m128i v = _mm_loadu_si128(p + i);
+                v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 1, 2, 0));
+                v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(3, 1, 2, 0));
+                w[i] = _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 1, 2, 0));
+            }
+            _mm_storeu_si128((__m128i *)(dstp[0] + 2 * x), _mm_unpacklo_epi64(w[0], w[1]));
+            _mm_storeu_si128((__m128i *)(dstp[0] + 2 * x + 8), _mm_unpacklo_epi64(w[2], w[3]));
+            __m128i c[2];
+            for (int i = 0; i < 2; i++) {
+                __m128i v = _mm_unpackhi_epi64(w[2 * i], w[2 * i + 1]);
+                v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 1, 2, 0));
+                v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(3, 1, 2, 0));
+                c[i] = _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 1, 2, 0));
+            }
+            _mm_storeu_si128((__m128i *)(dstc0 + x), _mm_unpacklo_epi64(c[0], c[1]));
+            _mm_storeu_si128((__m128i *)(dstc1 + x), _mm_unpackhi_epi64(c[0], c[1]));
+        }
+#endif
+        for (; x < width; x++) {
+            dstp[0][2 * x] = srcp[4 * x];
+            dstc0[x] = srcp[4 * x + 1];
+            dstp[0][2 * x + 1] = srcp[4 * x + 2];
+            dstc1[x] = srcp[4 * x + 3];
+        }
+
+        for (int p = 0; rows && p < 3; p++)
+            finish_row(rows, dst[0], p, y, vsapi);
+    }
+}
+
+
+static inline uint32_t bswap32(uint32_t v)
+{
+    return (v >> 24) | ((v >> 8) & 0xff00) | ((v << 8) & 0xff0000) | (v << 24);
+}
+
+
+static inline uint16_t bswap16(uint16_t v)
+{
+    return (uint16_t)((v >> 8) | (v << 8));
+}
+
+
+#ifdef __SSE2__
+static inline __m128i bswap32_sse2(__m128i v)
+{
+    v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    return _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+}
+#endif
+
+
+// 10-bit RGB in one 32-bit word per pixel, R in the high bits. DPX packing
+// method A pads the word at the bottom (pad = 2), method B at the top (pad = 0).
+// v410 is method A and Y410 method B with V, Y, U from the high bits, and
+// Y410 keeps a 2-bit alpha in the top bits, which is scaled to 16 bits
+static inline void
+write_rgb10(const rs_hnd_t *rh, const uint8_t *src, VSFrameRef **dst,
+            const rs_rows_t *rows, const VSAPI *vsapi, VSCore *core, int big_endian,
+            int pad)
+{
+    int width = rh->vi[0].width;
+    int height = rh->vi[0].height;
+    int src_stride = ((width << 2) + rh->row_adjust) & (~rh->row_adjust);
+
+    // the first stripe of a streamed frame creates the alpha frame
+    if (rh->has_alpha && !dst[1])
+        dst[1] = vsapi->newVideoFrame(rh->vi[1].format, rh->vi[1].width,
+                                      rh->vi[1].height, NULL, core);
+
+    for (int y = stripe_begin(rows), y_end = stripe_end(rows, height); y < y_end; y++) {
+        int yh = rh->flip_v ? height - y - 1 : y;
+        const uint32_t *srcp = (const uint32_t *)stripe_src(rows, src, yh, src_stride);
+        uint16_t *dstp[3];
+        for (int i = 0; i < 3; i++)
+            dstp[i] = (uint16_t *)(vsapi->getWritePtr(dst[0], rh->order[i]) +
+                                   (size_t)y * vsapi->getStride(dst[0], rh->order[i]));
+        uint16_t *dsta = rh->has_alpha ?
+            (uint16_t *)(vsapi->getWritePtr(dst[1], 0) + (size_t)y * vsapi->getStride(dst[1], 0)) :
+            NULL;
+
+        int x = 0;
+#ifdef __SSE2__
+        __m128i mask = _mm_set1_epi32(0x3ff);
+        for (; x + 8 <= width; x += 8) {
+            __m128i w0 = _mm_loadu_si128((const __m128i *)(srcp + x));
+            __m128i w1 = _mm_loadu_si128((const __m128i *)(srcp + x + 4));
+            if (big_endian) {
+                w0 = bswap32_sse2(w0);
+                w1 = bswap32_sse2(w1);
+            }
+            for (int i = 0; i < 3; i++) {
+                int shift = (2 - i) * 10 + pad;
+                __m128i c0 = _mm_and_si128(_mm_srli_epi32(w0, shift), mask);
+                __m128i c1 = _mm_and_si128(_mm_srli_epi32(w1, shift), mask);
+                _mm_storeu_si128((__m128i *)(dstp[i] + x), _mm_packs_epi32(c0, c1));
+            }
+            if (dsta) {
+                // 0~3 times 0x5555 is 0~65535
+                __m128i a = _mm_packs_epi32(_mm_srli_epi32(w0, 30), _mm_srli_epi32(w1, 30));
+                _mm_storeu_si128((__m128i *)(dsta + x), _mm_mullo_epi16(a, _mm_set1_epi16(0x5555)));
+            }
+        }
+#endif
+        for (; x < width; x++) {
+            uint32_t w = big_endian ? bswap32(srcp[x]) : srcp[x];
+            dstp[0][x] = (w >> (20 + pad)) & 0x3ff;
+            dstp[1][x] = (w >> (10 + pad)) & 0x3ff;
+            dstp[2][x] = (w >> pad) & 0x3ff;
+            if (dsta)
+                dsta[x] = (uint16_t)((w >> 30) * 0x5555);
+        }
+
+        for (int p = 0; rows && p < 3; p++)
+            finish_row(rows, dst[0], p, y, vsapi);
+    }
+}
+
+
+static void VS_CC
+write_rgb10a_le(const rs_hnd_t *rh, const uint8_t *src, VSFrameRef **dst,
+                const rs_rows_t *rows, const VSAPI *vsapi, VSCore *core)
+{
+    write_rgb10(rh, src, dst, rows, vsapi, core, 0, 2);
+}
+
+
+static void VS_CC
+write_rgb10a_be(const rs_hnd_t *rh, const uint8_t *src, VSFrameRef **dst,
+                const rs_rows_t *rows, const VSAPI *vsapi, VSCore *core)
+{
+    write_rgb10(rh, src, dst, rows, vsapi, core, 1, 2);
+}
+
+
+static void VS_CC
+write_rgb10b_le(const rs_hnd_t *rh, const uint8_t *src, VSFrameRef **dst,
+                const rs_rows_t *rows, const VSAPI *vsapi, VSCore *core)
+{
+    write_rgb10(rh, src, dst, rows, vsapi, core, 0, 0);
+}
+
+
+static void VS_CC
+write_rgb10b_be(const rs_hnd_t *rh, const uint8_t *src, VSFrameRef **dst,
+                const rs_rows_t *rows, const VSAPI *vsapi, VSCore *core)
+{
+    write_rgb10(rh, src, dst, rows, vsapi, core, 1, 0);
+}
+
+
+static void VS_CC
+write_packed_rgb48be(const rs_hnd_t *rh, const uint8_t *src, VSFrameRef **dst,
+                     const rs_rows_t *rows, const VSAPI *vsapi, VSCore *core)
+{
+    int width = rh->vi[0].width;
+    int height = rh->vi[0].height;
+    int src_stride = (width * 6 + rh->row_adjust) & (~rh->row_adjust);
+
+    for (int y = stripe_begin(rows), y_end = stripe_end(rows, height); y < y_end; y++) {
+        int yh = rh->flip_v ? height - y - 1 : y;
+        const uint16_t *srcp = (const uint16_t *)stripe_src(rows, src, yh, src_stride);
+        for (int i = 0; i < 3; i++) {
+            uint16_t *dstp = (uint16_t *)(vsapi->getWritePtr(dst[0], rh->order[i]) +
+                                          (size_t)y * vsapi->getStride(dst[0], rh->order[i]));
+            for (int x = 0; x < width; x++)
+                dstp[x] = bswap16(srcp[3 * x + i]);
+        }
+
+        for (int p = 0; rows && p < 3; p++)
+            finish_row(rows, dst[0], p, y, vsapi);
+    }
+}
+
+
+// four 16-bit samples per pixel, Y416 is U, Y, V, A. like write_packed_rgb32
+// order maps each sample to a plane, 3 being the alpha frame
+static void VS_CC
+write_packed_rgb64(const rs_hnd_t *rh, const uint8_t *src, VSFrameRef **dst,
+                   const rs_rows_t *rows, const VSAPI *vsapi, VSCore *core)
+{
+    int width = rh->vi[0].width;
+    int height = rh->vi[0].height;
+    int src_stride = ((width << 3) + rh->row_adjust) & (~rh->row_adjust);
+    const int *order = rh->order;
+
+    // the first stripe of a streamed frame creates the alpha frame
+    if (!dst[1])
+        dst[1] = vsapi->newVideoFrame(rh->vi[1].format, rh->vi[1].width,
+                                      rh->vi[1].height, NULL, core);
+
+    for (int y = stripe_begin(rows), y_end = stripe_end(rows, height); y < y_end; y++) {
+        int yh = rh->flip_v ? height - y - 1 : y;
+        const uint16_t *srcp = (const uint16_t *)stripe_src(rows, src, yh, src_stride);
+        uint16_t *planes[4];
+        for (int i = 0; i < 4; i++) {
+            VSFrameRef *f = i < 3 ? dst[0] : dst[1];
+            int plane = i < 3 ? i : 0;
+            planes[i] = (uint16_t *)(vsapi->getWritePtr(f, plane) +
+                                     (size_t)y * vsapi->getStride(f, plane));
+        }
+        uint16_t *dstp[4];
+        for (int i = 0; i < 4; i++)
+            dstp[i] = planes[order[i]];
+
+        int x = 0;
+#ifdef __SSE2__
+        for (; x + 8 <= width; x += 8) {
+            const __m128i *p = (const __m128i *)(srcp + 4 * x);
+            __m128i a = _mm_loadu_si128(p), b = _mm_loadu_si128(p + 1);
+            __m128i c = _mm_loadu_si128(p + 2), d = _mm_loadu_si128(p + 3);
+            // two rounds of unpacking gather 4 pixels of each sample in a half
+            __m128i t0 = _mm_unpacklo_epi16(a, b), t1 = _mm_unpackhi_epi16(a, b);
+            __m128i t2 = _mm_unpacklo_epi16(c, d), t3 = _mm_unpackhi_epi16(c, d);
+            __m128i s0 = _mm_unpacklo_epi16(t0, t1), s1 = _mm_unpackhi_epi16(t0, t1);
+            __m128i s2 = _mm_unpacklo_epi16(t2, t3), s3 = _mm_unpackhi_epi16(t2, t3);
+            _mm_storeu_si128((__m128i *)(dstp[0] + x), _mm_unpacklo_epi64(s0, s2));
+            _mm_storeu_si128((__m128i *)(dstp[1] + x), _mm_unpackhi_epi64(s0, s2));
+            _mm_storeu_si128((__m128i *)(dstp[2] + x), _mm_unpacklo_epi64(s1, s3));
+            _mm_storeu_si128((__m128i *)(dstp[3] + x), _mm_unpackhi_epi64(s1, s3));
+        }
+#endif
+        for (; x < width; x++) {
+            for (int i = 0; i < 4; i++)
+                dstp[i][x] = srcp[4 * x + i];
+        }
+
+        for (int p = 0; rows && p < 3; p++)
+            finish_row(rows, dst[0], p, y, vsapi);
+    }
+}
+
+
+// three or four 32-bit float samples per pixel, RGBF32 and RGBAF32. order
+// maps each sample to a plane, 3 being the alpha frame
+static inline void
+write_packed_float(const rs_hnd_t *rh, const uint8_t *src, VSFrameRef **dst,
+                   const rs_rows_t *rows, const VSAPI *vsapi, VSCore *core, int channels)
+{
+    int width = rh->vi[0].width;
+    int height = rh->vi[0].height;
+    int src_stride = (width * 4 * channels + rh->row_adjust) & (~rh->row_adjust);
+    const int *order = rh->order;
+
+    // the first stripe of a streamed frame creates the alpha frame
+    if (channels == 4 && !dst[1])
+        dst[1] = vsapi->newVideoFrame(rh->vi[1].format, rh->vi[1].width,
+                                      rh->vi[1].height, NULL, core);
+
+    for (int y = stripe_begin(rows), y_end = stripe_end(rows, height); y < y_end; y++) {
+        int yh = rh->flip_v ? height - y - 1 : y;
+        const float *srcp = (const float *)stripe_src(rows, src, yh, src_stride);
+        float *planes[4];
+        for (int i = 0; i < channels; i++) {
+            VSFrameRef *f = i < 3 ? dst[0] : dst[1];
+            int plane = i < 3 ? i : 0;
+            planes[i] = (float *)(vsapi->getWritePtr(f, plane) +
+                                  (size_t)y * vsapi->getStride(f, plane));
+        }
+        float *dstp[4];
+        for (int i = 0; i < channels; i++)
+            dstp[i] = planes[order[i]];
+
+        int x = 0;
+#ifdef __SSE2__
+        for (; x + 4 <= width; x += 4) {
+            const float *p = srcp + channels * x;
+            __m128 a = _mm_loadu_ps(p), b = _mm_loadu_ps(p + 4), c = _mm_loadu_ps(p + 8);
+            if (channels == 4) {
+                __m128 d = _mm_loadu_ps(p + 12);
+                _MM_TRANSPOSE4_PS(a, b, c, d);
+                _mm_storeu_ps(dstp[3] + x, d);
+                _mm_storeu_ps(dstp[0] + x, a);
+                _mm_storeu_ps(dstp[1] + x, b);
+                _mm_storeu_ps(dstp[2] + x, c);
+                continue;
+            }
+            // a = r0 g0 b0 r1, b = g1 b1 r2 g2, c = b2 r3 g3 b3
+            __m128 rbc = _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2));
+            __m128 gab = _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1));
+            __m128 gbc = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3));
+            __m128 bab = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2));
+            __m128 bcc = _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0));
+            _mm_storeu_ps(dstp[0] + x, _mm_shuffle_ps(a, rbc, _MM_SHUFFLE(2, 0, 3, 0)));
+            _mm_storeu_ps(dstp[1] + x, _mm_shuffle_ps(gab, gbc, _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_storeu_ps(dstp[2] + x, _mm_shuffle_ps(bab, bcc, _MM_SHUFFLE(2, 0, 2, 0)));
+        }
+#endif
+        for (; x < width; x++) {
+            for (int i = 0; i < channels; i++)
+                dstp[i][x] = srcp[channels * x + i];
+        }
+
+        for (int p = 0; rows && p < 3; p++)
+            finish_row(rows, dst[0], p, y, vsapi);
+    }
+}
+
+
+static void VS_CC
+write_packed_rgb96(const rs_hnd_t *rh, const uint8_t *src, VSFrameRef **dst,
+                   const rs_rows_t *rows, const VSAPI *vsapi, VSCore *core)
+{
+    write_packed_float(rh, src, dst, rows, vsapi, core, 3);
+}
+
+
+static void VS_CC
+write_packed_rgb128(const rs_hnd_t *rh, const uint8_t *src, VSFrameRef **dst,
+                    const rs_rows_t *rows, const VSAPI *vsapi, VSCore *core)
+{
+    write_packed_float(rh, src, dst, rows, vsapi, core, 4);
+}
+
+
+// MIPI CSI-2 RAW10 and RAW12, gray or a Bayer mosaic. RAW10 keeps the high
+// 8 bits of 4 pixels in 4 bytes and their low 2 bits in a fifth, RAW12 the
+// high 8 bits of 2 pixels and their low 4 bits in a third byte
+static inline int mipi_row_bytes(int width, int bits)
+{
+    return (int)((int64_t)width * bits / 8);
+}
+
+
+static void mipi_unpack_row_c(const uint8_t *src, uint16_t *dst, int x, int width, int bits)
+{
+    if (bits == 10) {
+        for (; x < width; x += 4) {
+            const uint8_t *p = src + x / 4 * 5;
+            for (int i = 0; i < 4; i++)
+                dst[x + i] = (uint16_t)((p[i] << 2) | ((p[4] >> (2 * i)) & 3));
+        }
+    } else {
+        for (; x < width; x += 2) {
+            const uint8_t *p = src + x / 2 * 3;
+            dst[x] = (uint16_t)((p[0] << 4) | (p[2] & 15));
+            dst[x + 1] = (uint16_t)((p[1] << 4) | (p[2] >> 4));
+        }
+    }
+}
+
+
+#ifdef RS_HAVE_SSSE3
+// 8 pixels from 10 or 12 bytes: one shuffle puts the high bits of every pixel
+// in the high byte of its word, another the byte with its low bits in the
+// low byte, and a multiply moves each pixel's low bits to the same place
+__attribute__((target("ssse3")))
+static void mipi_unpack_row_ssse3(const uint8_t *src, uint16_t *dst, int width, int bits)
+{
+    int group = bits == 10 ? 10 : 12;
+    int shift = 16 - bits;
+    __m128i hi_shuf = bits == 10 ?
+        _mm_setr_epi8(-1, 0, -1, 1, -1, 2, -1, 3, -1, 5, -1, 6, -1, 7, -1, 8) :
+        _mm_setr_epi8(-1, 0, -1, 1, -1, 3, -1, 4, -1, 6, -1, 7, -1, 9, -1, 10);
+    __m128i lo_shuf = bits == 10 ?
+        _mm_setr_epi8(4, -1, 4, -1, 4, -1, 4, -1, 9, -1, 9, -1, 9, -1, 9, -1) :
+        _mm_setr_epi8(2, -1, 2, -1, 5, -1, 5, -1, 8, -1, 8, -1, 11, -1, 11, -1);
+    __m128i mul = bits == 10 ? _mm_setr_epi16(64, 16, 4, 1, 64, 16, 4, 1) :
+                               _mm_setr_epi16(16, 1, 16, 1, 16, 1, 16, 1);
+    __m128i lo_mask = _mm_set1_epi16((1 << (bits - 8)) - 1);
+    __m128i count = _mm_cvtsi32_si128(shift);
+
+    // the loads read 16 bytes, so the last group of the row is left to C
+    int row_bytes = mipi_row_bytes(width, bits);
+    int x = 0;
+    for (; x + 8 <= width && x / 8 * group + 16 <= row_bytes; x += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + x / 8 * group));
+        __m128i hi = _mm_srl_epi16(_mm_shuffle_epi8(v, hi_shuf), count);
+        __m128i lo = _mm_mullo_epi16(_mm_shuffle_epi8(v, lo_shuf), mul);
+        lo = _mm_and_si128(_mm_srl_epi16(lo, count), lo_mask);
+        _mm_storeu_si128((__m128i *)(dst + x), _mm_or_si128(hi, lo));
+    }
+    mipi_unpack_row_c(src, dst, x, width, bits);
+}
+#endif
+
+
+static void mipi_unpack_row_sw(const uint8_t *src, uint16_t *dst, int width, int bits)
+{
+    mipi_unpack_row_c(src, dst, 0, width, bits);
+}
+
+
+static void (*mipi_unpack_row)(const uint8_t *, uint16_t *, int, int) = mipi_unpack_row_sw;
+
+static void mipi_init(void)
+{
+#ifdef RS_HAVE_SSSE3
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("ssse3"))
+        mipi_unpack_row = mipi_unpack_row_ssse3;
+#endif
+}
+
+
+static inline void
+write_mipi_raw(const rs_hnd_t *rh, const uint8_t *src, VSFrameRef **dst,
+               const rs_rows_t *rows, const VSAPI *vsapi, int bits)
+{
+    int width = rh->vi[0].width;
+    int height = rh->vi[0].height;
+    int src_stride = (mipi_row_bytes(width, bits) + rh->row_adjust) & (~rh->row_adjust);
+    uint8_t *dstp = vsapi->getWritePtr(dst[0], 0);
+    int dst_stride = vsapi->getStride(dst[0], 0);
+
+    for (int y = stripe_begin(rows), y_end = stripe_end(rows, height); y < y_end; y++) {
+        mipi_unpack_row(stripe_src(rows, src, y, src_stride),
+                        (uint16_t *)(dstp + (size_t)y * dst_stride), width, bits);
+        if (rows)
+            finish_row(rows, dst[0], 0, y, vsapi);
+    }
+}
+
+
+static void VS_CC
+write_mipi_raw10(const rs_hnd_t *rh, const uint8_t *src, VSFrameRef **dst,
+                 const rs_rows_t *rows, const VSAPI *vsapi, VSCore *core)
+{
+    write_mipi_raw(rh, src, dst, rows, vsapi, 10);
+}
+
+
+static void VS_CC
+write_mipi_raw12(const rs_hnd_t *rh, const uint8_t *src, VSFrameRef **dst,
+                 const rs_rows_t *rows, const VSAPI *vsapi, VSCore *core)
+{
+    write_mipi_raw(rh, src, dst, rows, vsapi, 12);
+}
+
+
+/* packers: the inverse of the write_* converters above. they take the planes
+ * of src[0] (and the alpha plane of src[1], which may be NULL) and lay them
+ * out in dst the way the matching converter expects to read them. */
+
+static const uint8_t *
+plane_row(const VSFrameRef *frame, int plane, int y, const VSAPI *vsapi)
+{
+    return vsapi->getReadPtr(frame, plane) + (size_t)y * vsapi->getStride(frame, plane);
+}
+
+
+static void VS_CC
+pack_planar_frame(const rs_hnd_t *rh, const VSFrameRef **src, uint8_t *dst,
+                  const VSAPI *vsapi)
+{
+    int bps = rh->vi[0].format->bytesPerSample;
+    int num_planes = rh->vi[0].format->numPlanes;
+
+    for (int i = 0; i < num_planes + rh->has_alpha; i++) {
+        const VSFrameRef *frame = i < num_planes ? src[0] : src[1];
+        int plane = i < num_planes ? rh->order[i] : 0;
+        int width = (i < num_planes ? vsapi->getFrameWidth(src[0], plane) : rh->vi[0].width) * bps;
+        int height = i < num_planes ? vsapi->getFrameHeight(src[0], plane) : rh->vi[0].height;
+        int row_size = (width + rh->row_adjust) & (~rh->row_adjust);
+
+        for (int y = 0; y < height; y++) {
+            if (frame)
+                memcpy(dst, plane_row(frame, plane, y, vsapi), width);
+            else
+                memset(dst, 0xFF, width);   // no alpha clip, fully opaque
+            memset(dst + width, 0, row_size - width);
+            dst += row_size;
+        }
+    }
+}
+
+
+static void VS_CC
+pack_nvxx_frame(const rs_hnd_t *rh, const VSFrameRef **src, uint8_t *dst,
+                const VSAPI *vsapi)
+{
+    int width = rh->vi[0].width;
+    int height = rh->vi[0].height;
+    int row_size = (width + rh->row_adjust) & (~rh->row_adjust);
+
+    for (int y = 0; y < height; y++) {
+        memcpy(dst, plane_row(src[0], 0, y, vsapi), width);
+        memset(dst + width, 0, row_size - width);
+        dst += row_size;
+    }
+
+    int chroma_width = vsapi->getFrameWidth(src[0], 1);
+    for (int y = 0; y < vsapi->getFrameHeight(src[0], 1); y++) {
+        const uint8_t *srcp0 = plane_row(src[0], rh->order[1], y, vsapi);
+        const uint8_t *srcp1 = plane_row(src[0], rh->order[2], y, vsapi);
+        int x = 0;
+#ifdef __SSE2__
+        for (; x + 16 <= chroma_width; x += 16) {
+            __m128i u = _mm_loadu_si128((const __m128i *)(srcp0 + x));
+            __m128i v = _mm_loadu_si128((const __m128i *)(srcp1 + x));
+            _mm_storeu_si128((__m128i *)(dst + 2 * x), _mm_unpacklo_epi8(u, v));
+            _mm_storeu_si128((__m128i *)(dst + 2 * x + 16), _mm_unpackhi_epi8(u, v));
+        }
+#endif
+        for (; x < chroma_width; x++) {
+            dst[2 * x] = srcp0[x];
+            dst[2 * x + 1] = srcp1[x];
+        }
+        memset(dst + 2 * chroma_width, 0, row_size - 2 * chroma_width);
+        dst += row_size;
+    }
+}
+
+
+static void VS_CC
+pack_px1x_frame(const rs_hnd_t *rh, const VSFrameRef **src, uint8_t *dst,
+                const VSAPI *vsapi)
+{
+    int width = rh->vi[0].width << 1;
+    int height = rh->vi[0].height;
+    int row_size = (width + rh->row_adjust) & (~rh->row_adjust);
+
+    for (int y = 0; y < height; y++) {
+        memcpy(dst, plane_row(src[0], 0, y, vsapi), width);
+        memset(dst + width, 0, row_size - width);
+        dst += row_size;
+    }
+
+    int chroma_width = vsapi->getFrameWidth(src[0], 1);
+    for (int y = 0; y < vsapi->getFrameHeight(src[0], 1); y++) {
+        const uint16_t *srcp0 = (const uint16_t *)plane_row(src[0], rh->order[1], y, vsapi);
+        const uint16_t *srcp1 = (const uint16_t *)plane_row(src[0], rh->order[2], y, vsapi);
+        uint16_t *dstp = (uint16_t *)dst;
+        int x = 0;
+#ifdef __SSE2__
+        for (; x + 8 <= chroma_width; x += 8) {
+            __m128i u = _mm_loadu_si128((const __m128i *)(srcp0 + x));
+            __m128i v = _mm_loadu_si128((const __m128i *)(srcp1 + x));
+            _mm_storeu_si128((__m128i *)(dstp + 2 * x), _mm_unpacklo_epi16(u, v));
+            _mm_storeu_si128((__m128i *)(dstp + 2 * x + 8), _mm_unpackhi_epi16(u, v));
+        }
+#endif
+        for (; x < chroma_width; x++) {
+            dstp[2 * x] = srcp0[x];
+            dstp[2 * x + 1] = srcp1[x];
+        }
+        memset(dst + 4 * chroma_width, 0, row_size - 4 * chroma_width);
+        dst += row_size;
+    }
+}
+
+
+static void VS_CC
+pack_packed_rgb24(const rs_hnd_t *rh, const VSFrameRef **src, uint8_t *dst,
+                  const VSAPI *vsapi)
+{
+    int width = rh->vi[0].width;
+    int height = rh->vi[0].height;
+    int row_size = (width * 3 + rh->row_adjust) & (~rh->row_adjust);
+
+    for (int y = 0; y < height; y++) {
+        int yh = rh->flip_v ? height - y - 1 : y;
+        const uint8_t *srcp0 = plane_row(src[0], rh->order[0], yh, vsapi);
+        const uint8_t *srcp1 = plane_row(src[0], rh->order[1], yh, vsapi);
+        const uint8_t *srcp2 = plane_row(src[0], rh->order[2], yh, vsapi);
+        for (int x = 0; x < width; x++) {
+            dst[3 * x] = srcp0[x];
+            dst[3 * x + 1] = srcp1[x];
+            dst[3 * x + 2] = srcp2[x];
+        }
+        memset(dst + width * 3, 0, row_size - width * 3);
+        dst += row_size;
+    }
+}
+
+
+static void VS_CC
+pack_packed_rgb48(const rs_hnd_t *rh, const VSFrameRef **src, uint8_t *dst,
+                  const VSAPI *vsapi)
+{
+    int width = rh->vi[0].width;
+    int height = rh->vi[0].height;
+    int row_size = (width * 6 + rh->row_adjust) & (~rh->row_adjust);
+
+    for (int y = 0; y < height; y++) {
+        int yh = rh->flip_v ? height - y - 1 : y;
+        const uint16_t *srcp0 = (const uint16_t *)plane_row(src[0], rh->order[0], yh, vsapi);
+        const uint16_t *srcp1 = (const uint16_t *)plane_row(src[0], rh->order[1], yh, vsapi);
+        const uint16_t *srcp2 = (const uint16_t *)plane_row(src[0], rh->order[2], yh, vsapi);
+        uint16_t *dstp = (uint16_t *)dst;
+        for (int x = 0; x < width; x++) {
+            dstp[3 * x] = srcp0[x];
+            dstp[3 * x + 1] = srcp1[x];
+            dstp[3 * x + 2] = srcp2[x];
+        }
+        memset(dst + width * 6, 0, row_size - width * 6);
+        dst += row_size;
+    }
+}
+
+
+static void VS_CC
+pack_packed_rgb32(const rs_hnd_t *rh, const VSFrameRef **src, uint8_t *dst,
+                  const VSAPI *vsapi)
+{
+    int width = rh->vi[0].width;
+    int height = rh->vi[0].height;
+    int row_size = ((width << 2) + rh->row_adjust) & (~rh->row_adjust);
+    for (int y = 0; y < height; y++) {
+        int yh = rh->flip_v ? height - y - 1 : y;
+        const uint8_t *planes[4];
+        for (int i = 0; i < 3; i++)
+            planes[i] = plane_row(src[0], i, yh, vsapi);
+        planes[3] = src[1] ? plane_row(src[1], 0, yh, vsapi) : (const uint8_t *)rh->opaque_row;
+
+        const uint8_t *srcp0 = planes[rh->order[0]];
+        const uint8_t *srcp1 = planes[rh->order[1]];
+        const uint8_t *srcp2 = planes[rh->order[2]];
+        const uint8_t *srcp3 = planes[rh->order[3]];
+        int x = 0;
+#ifdef __SSE2__
+        for (; x + 16 <= width; x += 16) {
+            __m128i c0 = _mm_loadu_si128((const __m128i *)(srcp0 + x));
+            __m128i c1 = _mm_loadu_si128((const __m128i *)(srcp1 + x));
+            __m128i c2 = _mm_loadu_si128((const __m128i *)(srcp2 + x));
+            __m128i c3 = _mm_loadu_si128((const __m128i *)(srcp3 + x));
+            __m128i lo01 = _mm_unpacklo_epi8(c0, c1);
+            __m128i hi01 = _mm_unpackhi_epi8(c0, c1);
+            __m128i lo23 = _mm_unpacklo_epi8(c2, c3);
+            __m128i hi23 = _mm_unpackhi_epi8(c2, c3);
+            _mm_storeu_si128((__m128i *)(dst + 4 * x), _mm_unpacklo_epi16(lo01, lo23));
+            _mm_storeu_si128((__m128i *)(dst + 4 * x + 16), _mm_unpackhi_epi16(lo01, lo23));
+            _mm_storeu_si128((__m128i *)(dst + 4 * x + 32), _mm_unpacklo_epi16(hi01, hi23));
+            _mm_storeu_si128((__m128i *)(dst + 4 * x + 48), _mm_unpackhi_epi16(hi01, hi23));
+        }
+#endif
+        for (; x < width; x++) {
+            dst[4 * x] = srcp0[x];
+            dst[4 * x + 1] = srcp1[x];
+            dst[4 * x + 2] = srcp2[x];
+            dst[4 * x + 3] = srcp3[x];
+        }
+        memset(dst + (width << 2), 0, row_size - (width << 2));
+        dst += row_size;
+    }
+}
+
+
+static void VS_CC
+pack_packed_yuv422(const rs_hnd_t *rh, const VSFrameRef **src, uint8_t *dst,
+                   const VSAPI *vsapi)
+{
+    int width = rh->vi[0].width >> 1;
+    int height = rh->vi[0].height;
+    int row_size = ((rh->vi[0].width << 1) + rh->row_adjust) & (~rh->row_adjust);
+    const int *order = rh->order;
+
+    // luma is either in bytes 0 and 2 or in bytes 1 and 3 of every group
+    int luma_first = order[0] == 0;
+    int c0 = order[luma_first ? 1 : 0];
+    int c1 = order[luma_first ? 3 : 2];
+
+    for (int y = 0; y < height; y++) {
+        const uint8_t *srcy = plane_row(src[0], 0, y, vsapi);
+        const uint8_t *srcc0 = plane_row(src[0], c0, y, vsapi);
+        const uint8_t *srcc1 = plane_row(src[0], c1, y, vsapi);
+        int x = 0;
+#ifdef __SSE2__
+        for (; x + 16 <= width; x += 16) {
+            __m128i l0 = _mm_loadu_si128((const __m128i *)(srcy + 2 * x));
+            __m128i l1 = _mm_loadu_si128((const __m128i *)(srcy + 2 * x + 16));
+            __m128i u = _mm_loadu_si128((const __m128i *)(srcc0 + x));
+            __m128i v = _mm_loadu_si128((const __m128i *)(srcc1 + x));
+            __m128i clo = _mm_unpacklo_epi8(u, v);
+            __m128i chi = _mm_unpackhi_epi8(u, v);
+            __m128i *dstp = (__m128i *)(dst + 4 * x);
+            if (luma_first) {
+                _mm_storeu_si128(dstp + 0, _mm_unpacklo_epi8(l0, clo));
+                _mm_storeu_si128(dstp + 1, _mm_unpackhi_epi8(l0, clo));
+                _mm_storeu_si128(dstp + 2, _mm_unpacklo_epi8(l1, chi));
+                _mm_storeu_si128(dstp + 3, _mm_unpackhi_epi8(l1, chi));
+            } else {
+                _mm_storeu_si128(dstp + 0, _mm_unpacklo_epi8(clo, l0));
+                _mm_storeu_si128(dstp + 1, _mm_unpackhi_epi8(clo, l0));
+                _mm_storeu_si128(dstp + 2, _mm_unpacklo_epi8(chi, l1));
+                _mm_storeu_si128(dstp + 3, _mm_unpackhi_epi8(chi, l1));
+            }
+        }
+#endif
+        for (; x < width; x++) {
+            uint8_t *d = dst + 4 * x;
+            d[luma_first ? 0 : 1] = srcy[2 * x];
+            d[luma_first ? 2 : 3] = srcy[2 * x + 1];
+            d[luma_first ? 1 : 0] = srcc0[x];
+            d[luma_first ? 3 : 2] = srcc1[x];
+        }
+        memset(dst + (width << 2), 0, row_size - (width << 2));
+        dst += row_size;
+    }
+}
+
+
+static void VS_CC
+pack_packed_yuv422_16(const rs_hnd_t *rh, const VSFrameRef **src, uint8_t *dst,
+                      const VSAPI *vsapi)
+{
+    int width = rh->vi[0].width >> 1;
+    int height = rh->vi[0].height;
+    int row_size = ((rh->vi[0].width << 2) + rh->row_adjust) & (~rh->row_adjust);
+
+    for (int y = 0; y < height; y++) {
+        const uint16_t *srcy = (const uint16_t *)plane_row(src[0], 0, y, vsapi);
+        const uint16_t *srcc0 = (const uint16_t *)plane_row(src[0], rh->order[1], y, vsapi);
+        const uint16_t *srcc1 = (const uint16_t *)plane_row(src[0], rh->order[3], y, vsapi);
+        uint16_t *dstp = (uint16_t *)dst;
+        int x = 0;
+#ifdef __SSE2__
+        for (; x + 8 <= width; x += 8) {
+            __m128i l0 = _mm_loadu_si128((const __m128i *)(srcy + 2 * x));
+            __m128i l1 = _mm_loadu_si128((const __m128i *)(srcy + 2 * x + 8));
+            __m128i u = _mm_loadu_si128((const __m128i *)(srcc0 + x));
+            __m128i v = _mm_loadu_si128((const __m128i *)(srcc1 + x));
+            __m128i clo = _mm_unpacklo_epi16(u, v);
+            __m128i chi = _mm_unpackhi_epi16(u, v);
+            __m128i *p = (__m128i *)(dstp + 4 * x);
+            _mm_storeu_si128(p + 0, _mm_unpacklo_epi16(l0, clo));
+            _mm_storeu_si128(p + 1, _mm_unpackhi_epi16(l0, clo));
+            _mm_storeu_si128(p + 2, _mm_unpacklo_epi16(l1, chi));
+            _mm_storeu_si128(p + 3, _mm_unpackhi_epi16(l1, chi));
+        }
+#endif
+        for (; x < width; x++) {
+            dstp[4 * x] = srcy[2 * x];
+            dstp[4 * x + 1] = srcc0[x];
+            dstp[4 * x + 2] = srcy[2 * x + 1];
+            dstp[4 * x + 3] = srcc1[x];
+        }
+        memset(dst + (width << 3), 0, row_size - (width << 3));
+        dst += row_size;
+    }
+}
+
+
+static inline void
+pack_rgb10(const rs_hnd_t *rh, const VSFrameRef **src, uint8_t *dst,
+           const VSAPI *vsapi, int big_endian, int pad)
+{
+    int width = rh->vi[0].width;
+    int height = rh->vi[0].height;
+    int row_size = ((width << 2) + rh->row_adjust) & (~rh->row_adjust);
+
+    for (int y = 0; y < height; y++) {
+        int yh = rh->flip_v ? height - y - 1 : y;
+        const uint16_t *srcp0 = (const uint16_t *)plane_row(src[0], rh->order[0], yh, vsapi);
+        const uint16_t *srcp1 = (const uint16_t *)plane_row(src[0], rh->order[1], yh, vsapi);
+        const uint16_t *srcp2 = (const uint16_t *)plane_row(src[0], rh->order[2], yh, vsapi);
+        uint32_t *dstp = (uint32_t *)dst;
+        // Y410 keeps the top 2 bits of alpha, without it the pixel is opaque
+        const uint16_t *srca = rh->has_alpha && src[1] ?
+            (const uint16_t *)plane_row(src[1], 0, yh, vsapi) : NULL;
+        uint32_t opaque = rh->has_alpha ? 3u << 30 : 0;
+        for (int x = 0; x < width; x++) {
+            uint32_t w = ((uint32_t)(srcp0[x] & 0x3ff) << (20 + pad)) |
+                         ((uint32_t)(srcp1[x] & 0x3ff) << (10 + pad)) |
+                         ((uint32_t)(srcp2[x] & 0x3ff) << pad) |
+                         (srca ? (uint32_t)(srca[x] >> 14) << 30 : opaque);
+            dstp[x] = big_endian ? bswap32(w) : w;
+        }
+        memset(dst + (width << 2), 0, row_size - (width << 2));
+        dst += row_size;
+    }
+}
+
+
+static void VS_CC
+pack_rgb10a_le(const rs_hnd_t *rh, const VSFrameRef **src, uint8_t *dst,
+               const VSAPI *vsapi)
+{
+    pack_rgb10(rh, src, dst, vsapi, 0, 2);
+}
+
+
+static void VS_CC
+pack_rgb10a_be(const rs_hnd_t *rh, const VSFrameRef **src, uint8_t *dst,
+               const VSAPI *vsapi)
+{
+    pack_rgb10(rh, src, dst, vsapi, 1, 2);
+}
+
+
+static void VS_CC
+pack_rgb10b_le(const rs_hnd_t *rh, const VSFrameRef **src, uint8_t *dst,
+               const VSAPI *vsapi)
+{
+    pack_rgb10(rh, src, dst, vsapi, 0, 0);
+}
+
+
+static void VS_CC
+pack_rgb10b_be(const rs_hnd_t *rh, const VSFrameRef **src, uint8_t *dst,
+               const VSAPI *vsapi)
+{
+    pack_rgb10(rh, src, dst, vsapi, 1, 0);
+}
+
+
+static void VS_CC
+pack_packed_rgb48be(const rs_hnd_t *rh, const VSFrameRef **src, uint8_t *dst,
+                    const VSAPI *vsapi)
+{
+    int width = rh->vi[0].width;
+    int height = rh->vi[0].height;
+    int row_size = (width * 6 + rh->row_adjust) & (~rh->row_adjust);
+
+    for (int y = 0; y < height; y++) {
+        int yh = rh->flip_v ? height - y - 1 : y;
+        uint16_t *dstp = (uint16_t *)dst;
+        for (int i = 0; i < 3; i++) {
+            const uint16_t *srcp = (const uint16_t *)plane_row(src[0], rh->order[i], yh, vsapi);
+            for (int x = 0; x < width; x++)
+                dstp[3 * x + i] = bswap16(srcp[x]);
+        }
+        memset(dst + width * 6, 0, row_size - width * 6);
+        dst += row_size;
+    }
+}
+
+
+static void VS_CC
+pack_packed_rgb64(const rs_hnd_t *rh, const VSFrameRef **src, uint8_t *dst,
+                  const VSAPI *vsapi)
+{
+    int width = rh->vi[0].width;
+    int height = rh->vi[0].height;
+    int row_size = ((width << 3) + rh->row_adjust) & (~rh->row_adjust);
+
+    for (int y = 0; y < height; y++) {
+        int yh = rh->flip_v ? height - y - 1 : y;
+        const uint16_t *planes[4];
+        for (int i = 0; i < 3; i++)
+            planes[i] = (const uint16_t *)plane_row(src[0], i, yh, vsapi);
+        planes[3] = src[1] ? (const uint16_t *)plane_row(src[1], 0, yh, vsapi)
+                           : (const uint16_t *)rh->opaque_row;
+
+        const uint16_t *srcp[4];
+        for (int i = 0; i < 4; i++)
+            srcp[i] = planes[rh->order[i]];
+        uint16_t *dstp = (uint16_t *)dst;
+        int x = 0;
+#ifdef __SSE2__
+        for (; x + 8 <= width; x += 8) {
+            __m128i c0 = _mm_loadu_si128((const __m128i *)(srcp[0] + x));
+            __m128i c1 = _mm_loadu_si128((const __m128i *)(srcp[1] + x));
+            __m128i c2 = _mm_loadu_si128((const __m128i *)(srcp[2] + x));
+            __m128i c3 = _mm_loadu_si128((const __m128i *)(srcp[3] + x));
+            __m128i lo01 = _mm_unpacklo_epi16(c0, c1), hi01 = _mm_unpackhi_epi16(c0, c1);
+            __m128i lo23 = _mm_unpacklo_epi16(c2, c3), hi23 = _mm_unpackhi_epi16(c2, c3);
+            __m128i *p = (__m128i *)(dstp + 4 * x);
+            _mm_storeu_si128(p, _mm_unpacklo_epi32(lo01, lo23));
+            _mm_storeu_si128(p + 1, _mm_unpackhi_epi32(lo01, lo23));
+            _mm_storeu_si128(p + 2, _mm_unpacklo_epi32(hi01, hi23));
+            _mm_storeu_si128(p + 3, _mm_unpackhi_epi32(hi01, hi23));
+        }
+#endif
+        for (; x < width; x++) {
+            for (int i = 0; i < 4; i++)
+                dstp[4 * x + i] = srcp[i][x];
+        }
+        memset(dst + (width << 3), 0, row_size - (width << 3));
+        dst += row_size;
+    }
+}
+
+
+static inline void
+pack_packed_float(const rs_hnd_t *rh, const VSFrameRef **src, uint8_t *dst,
+                  const VSAPI *vsapi, int channels)
+{
+    int width = rh->vi[0].width;
+    int height = rh->vi[0].height;
+    int row_bytes = width * 4 * channels;
+    int row_size = (row_bytes + rh->row_adjust) & (~rh->row_adjust);
+    const float opaque = 1.0f;
+
+    for (int y = 0; y < height; y++) {
+        int yh = rh->flip_v ? height - y - 1 : y;
+        const float *planes[4];
+        for (int i = 0; i < 3; i++)
+            planes[i] = (const float *)plane_row(src[0], i, yh, vsapi);
+        planes[3] = src[1] ? (const float *)plane_row(src[1], 0, yh, vsapi) : NULL;
+
+        float *dstp = (float *)dst;
+        for (int i = 0; i < channels; i++) {
+            const float *srcp = planes[rh->order[i]];
+            for (int x = 0; x < width; x++)
+                dstp[channels * x + i] = srcp ? srcp[x] : opaque;
+        }
+        memset(dst + row_bytes, 0, row_size - row_bytes);
+        dst += row_size;
+    }
+}
+
+
+static void VS_CC
+pack_packed_rgb96(const rs_hnd_t *rh, const VSFrameRef **src, uint8_t *dst,
+                  const VSAPI *vsapi)
+{
+    pack_packed_float(rh, src, dst, vsapi, 3);
+}
+
+
+static void VS_CC
+pack_packed_rgb128(const rs_hnd_t *rh, const VSFrameRef **src, uint8_t *dst,
+                   const VSAPI *vsapi)
+{
+    pack_packed_float(rh, src, dst, vsapi, 4);
+}
+
+
+static inline void
+pack_mipi_raw(const rs_hnd_t *rh, const VSFrameRef **src, uint8_t *dst,
+              const VSAPI *vsapi, int bits)
+{
+    int width = rh->vi[0].width;
+    int height = rh->vi[0].height;
+    int row_bytes = mipi_row_bytes(width, bits);
+    int row_size = (row_bytes + rh->row_adjust) & (~rh->row_adjust);
+
+    for (int y = 0; y < height; y++) {
+        const uint16_t *srcp = (const uint16_t *)plane_row(src[0], 0, y, vsapi);
+        if (bits == 10) {
+            for (int x = 0; x < width; x += 4) {
+                uint8_t *p = dst + x / 4 * 5;
+                p[4] = 0;
+                for (int i = 0; i < 4; i++) {
+                    p[i] = (uint8_t)(srcp[x + i] >> 2);
+                    p[4] |= (uint8_t)((srcp[x + i] & 3) << (2 * i));
+                }
+            }
+        } else {
+            for (int x = 0; x < width; x += 2) {
+                uint8_t *p = dst + x / 2 * 3;
+                p[0] = (uint8_t)(srcp[x] >> 4);
+                p[1] = (uint8_t)(srcp[x + 1] >> 4);
+                p[2] = (uint8_t)((srcp[x] & 15) | ((srcp[x + 1] & 15) << 4));
+            }
+        }
+        memset(dst + row_bytes, 0, row_size - row_bytes);
+        dst += row_size;
+    }
+}
+
+
+static void VS_CC
+pack_mipi_raw10(const rs_hnd_t *rh, const VSFrameRef **src, uint8_t *dst,
+                const VSAPI *vsapi)
+{
+    pack_mipi_raw(rh, src, dst, vsapi, 10);
+}
+
+
+static void VS_CC
+pack_mipi_raw12(const rs_hnd_t *rh, const VSFrameRef **src, uint8_t *dst,
+                const VSAPI *vsapi)
+{
+    pack_mipi_raw(rh, src, dst, vsapi, 12);
+}
+
+
+// read and decompress frame n of a container into a newly allocated buffer.
+// each call has its own buffers so that frames can be decoded in parallel.
+static uint8_t *read_rsz_frame(rs_hnd_t *rh, int n, const VSAPI *vsapi)
+{
+    int64_t pos = rh->index[n];
+    size_t block_size = rh->index_size[n];
+
+    uint8_t *frame = (uint8_t *)malloc(rh->frame_size + 32);
+    if (!frame)
+        return NULL;
+
+    // blocks that didn't compress are stored as is
+    if (block_size == rh->frame_size) {
+        if (read_at(rh, frame, block_size, pos) != 0) {
+            free(frame);
+            return NULL;
+        }
+        return frame;
+    }
+
+    uint8_t *block = (uint8_t *)malloc(block_size);
+    if (!block || read_at(rh, block, block_size, pos) != 0) {
+        free(block);
+        free(frame);
+        return NULL;
+    }
+
+    size_t decoded = 0;
+    switch (rh->codec) {
+#ifdef HAVE_LZ4
+    case RSZ_CODEC_LZ4: {
+        int ret = LZ4_decompress_safe((const char *)block, (char *)frame,
+                                      (int)block_size, (int)rh->frame_size);
+        decoded = ret < 0 ? 0 : (size_t)ret;
+        break;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    case RSZ_CODEC_ZSTD: {
+        size_t ret = ZSTD_decompress(frame, rh->frame_size, block, block_size);
+        decoded = ZSTD_isError(ret) ? 0 : ret;
+        break;
+    }
+#endif
+    default:
+        break;
+    }
+    free(block);
+
+    if (decoded != rh->frame_size) {
+        VS_LOG(mtCritical, "read_rsz_frame: failed to decompress frame %d", n);
+        free(frame);
+        return NULL;
+    }
+
+    return frame;
+}
+
+
+// compress a frame into dst, returns 0 if it doesn't fit in capacity
+static size_t compress_block(uint32_t codec, int level, const uint8_t *src, size_t size,
+                             uint8_t *dst, size_t capacity)
+{
+    switch (codec) {
+#ifdef HAVE_LZ4
+    case RSZ_CODEC_LZ4:
+        if (size > LZ4_MAX_INPUT_SIZE)
+            return 0;
+        return (size_t)LZ4_compress_default((const char *)src, (char *)dst,
+                                            (int)size, (int)capacity);
+#endif
+#ifdef HAVE_ZSTD
+    case RSZ_CODEC_ZSTD: {
+        size_t ret = ZSTD_compress(dst, capacity, src, size, level);
+        return ZSTD_isError(ret) ? 0 : ret;
+    }
+#endif
+    default:
+        return 0;
+    }
+}
+
+
+static int segment_frames(const rs_hnd_t *rh, int64_t size)
+{
+    int64_t frames = (size - rh->off_header) / (int64_t)(rh->off_frame + rh->frame_size);
+    return frames > 0 ? (int)frames : 0;
+}
+
+
+static int VS_CC create_index(rs_hnd_t *rh)
+{
+    int num_frames = rh->vi[0].numFrames;
+
+    int64_t *index = (int64_t *)malloc(sizeof(int64_t) * num_frames);
+    if (!index) {
+        return -1;
+    }
+
+    if (rh->num_segments > 1) {
+        rh->index_segment = (int *)malloc(sizeof(int) * num_frames);
+        if (!rh->index_segment) {
+            free(index);
+            return -1;
+        }
+    }
+
+    int off_frame = rh->off_frame;
+    uint64_t frame_size = rh->frame_size;
+    int i = 0;
+    for (int s = 0; s < rh->num_segments; s++) {
+        // every segment starts with the same header as the first
+        int frames = segment_frames(rh, s ? rh->segment_size[s] : rh->file_size);
+        int64_t pos = rh->off_header;
+        for (int j = 0; j < frames; j++, i++) {
+            pos += off_frame;
+            index[i] = pos;
+            if (rh->index_segment)
+                rh->index_segment[i] = s;
+            pos += frame_size;
+        }
+    }
+
+    rh->index = index;
+    return 0;
+}
+
+
+// follow: extend the index as the file grows until it holds frame n,
+// checking its size every 10ms for up to rh->follow ms
+static int follow_index(rs_hnd_t *rh, int n)
+{
+    for (int waited = 0; ; waited += 10) {
+        if (rs_fseek(rh->file, 0, SEEK_END) != 0)
+            return -1;
+        int frames = segment_frames(rh, rs_ftell(rh->file));
+        if (frames > n)
+            break;
+        if (waited >= rh->follow)
+            return -1;
+        rs_sleep_ms(10);
+    }
+
+    int frames = segment_frames(rh, rs_ftell(rh->file));
+    if (frames > rh->vi[0].numFrames)
+        frames = rh->vi[0].numFrames;
+    if (frames > rh->index_capacity) {
+        int capacity = rh->index_capacity * 2 > frames ? rh->index_capacity * 2 : frames;
+        int64_t *index = (int64_t *)realloc(rh->index, sizeof(int64_t) * capacity);
+        if (!index)
+            return -1;
+        rh->index = index;
+        rh->index_capacity = capacity;
+    }
+
+    for (int i = rh->index_frames; i < frames; i++)
+        rh->index[i] = rh->off_header + (int64_t)(rh->off_frame + rh->frame_size) * i +
+                       rh->off_frame;
+    rh->index_frames = frames;
+    return 0;
+}
+
+
+static int64_t gcd_i64(int64_t a, int64_t b)
+{
+    while (b) {
+        int64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+
+// keep only frames start, start + step, ... before end in the index, so
+// the frames in between are never read
+static void decimate_index(rs_hnd_t *rh, int start, int end, int step)
+{
+    int num_frames = (end - start + step - 1) / step;
+
+    for (int i = 0; i < num_frames; i++) {
+        int src = start + i * step;
+        rh->index[i] = rh->index[src];
+        if (rh->index_segment)
+            rh->index_segment[i] = rh->index_segment[src];
+        if (rh->index_size)
+            rh->index_size[i] = rh->index_size[src];
+        if (rh->manifest && src < rh->manifest_frames)
+            rh->manifest[i] = rh->manifest[src];
+    }
+    if (rh->manifest) {
+        int kept = (rh->manifest_frames - start + step - 1) / step;
+        rh->manifest_frames = kept < 0 ? 0 : kept < num_frames ? kept : num_frames;
+    }
+    rh->vi[0].numFrames = num_frames;
+
+    // every frame left now lasts for step source frames
+    int64_t den = rh->vi[0].fpsDen * step;
+    int64_t gcd = gcd_i64(rh->vi[0].fpsNum, den);
+    rh->vi[0].fpsNum /= gcd;
+    rh->vi[0].fpsDen = den / gcd;
+}
+
+
+static const struct {
+    const char *tag;
+    const char *format;
+} y4m_formats[] = {
+    { "420",      "YUV420P8"  },
+    { "420jpeg",  "YUV420P8"  },
+    { "420mpeg2", "YUV420P8"  },
+    { "420paldv", "YUV420P8"  },
+    { "420p9",    "YUV420P9"  },
+    { "420p10",   "YUV420P10" },
+    { "420p16",   "YUV420P16" },
+    { "410",      "YUV410P8"  },
+    { "411",      "YUV411P8"  },
+    { "422",      "YUV422P8"  },
+    { "422p9",    "YUV422P9"  },
+    { "422p10",   "YUV422P10" },
+    { "422p16",   "YUV422P16" },
+    { "440",      "YUV440P8"  },
+    { "444",      "YUV444P8"  },
+    { "444p9",    "YUV444P9"  },
+    { "444p10",   "YUV444P10" },
+    { "444p16",   "YUV444P16" },
+    { "444alpha", "YUV444P8A" },
+    { "444p32",   "YUV444PS"  },
+    { "mono",     "GRAY"      },
+    { "mono16",   "GRAY16"    },
+    { "mono32",   "GRAYS"     },
+};
+
+#define NUM_Y4M_FORMATS ((int)(sizeof(y4m_formats) / sizeof(y4m_formats[0])))
+
+
+static inline const char * VS_CC get_format(char *ctag)
+{
+    for (int i = 0; i < NUM_Y4M_FORMATS; i++) {
+        if (strcasecmp(ctag, y4m_formats[i].tag) == 0)
+            return y4m_formats[i].format;
+    }
+
+    return "";
+}
+
+
+#define PARSE_HEADER(cond, ...) {\
+    i += 2;\
+    sscanf(buff + i, __VA_ARGS__);\
+    if (cond) {\
+        return -1;\
+    }\
+}
+static int VS_CC check_y4m(rs_hnd_t *rh, const VSAPI *vsapi)
+{
+    const char *stream_header = "YUV4MPEG2" + rh->magic_size;
+    const char *frame_header = "FRAME\n";
+    size_t sh_length = strlen(stream_header);
+    size_t fh_length = strlen(frame_header);
+    char buff[256] = { 0 };
+    char ctag[32] = { 0 };
+
+    if (buff != fgets(buff, sizeof(buff), rh->file))
+        return 1;
+
+    if (strncmp(buff, stream_header, sh_length) != 0)
+        return 1;
+
+    size_t i;
+    for (i = sh_length; buff[i] != '\n'; i++) {
+        if (!strncmp(buff + i, " W", 2)) {
+            PARSE_HEADER(rh->vi[0].width < 1, "%d", &rh->vi[0].width);
+        }
+        if (!strncmp(buff + i, " H", 2)) {
+            PARSE_HEADER(rh->vi[0].height < 1, "%d", &rh->vi[0].height);
+        }
+        if (!strncmp(buff + i, " F", 2)) {
+            i += 2;
+            sscanf(buff + i, "%"SCNi64":%"SCNi64, &rh->vi[0].fpsNum, &rh->vi[0].fpsDen);
+            if (rh->vi[0].fpsNum < 1 || rh->vi[0].fpsDen < 1) {
+                return -1;
+            }
+        }
+        if (!strncmp(buff + i, " A", 2)) {
+            i += 2;
+            sscanf(buff + i, "%d:%d", &rh->sar_num, &rh->sar_den);
+            if (rh->sar_num < 0 || rh->sar_den < 0) {
+                return -1;
+            }
+        }
+        if (!strncmp(buff + i, " I", 2)) {
+            i += 2;
+            if (buff[i] == 'm') {
+                return -2;
+            }
+        }
+        if (!strncmp(buff + i, " C", 2)) {
+            i += 2;
+            sscanf(buff + i, "%s", ctag);
+            strcpy(rh->src_format, get_format(ctag));
+
+            if (strlen(rh->src_format) == 0)
+                VS_LOG(mtWarning, "check_y4m: unknown frame format in y4m header: %s", ctag);
+        }
+        if (i == sizeof buff - 1) {
+            return -2;
+        }
+    }
+
+    rh->off_header = (int)(++i + rh->magic_size);
+    rh->off_frame = (int)fh_length;
+
+    if (strlen(rh->src_format) == 0) {
+        VS_LOG(mtWarning, "check_y4m: assuming the format is YUV420P8");
+        strcpy(rh->src_format, "YUV420P8");
+    }
+
+    rh->row_adjust = 1;
+    return 0;
+}
+#undef PARSE_HEADER
+
+
+static inline int32_t abs_i(int32_t i)
+{
+    return i < 0 ? -i : i;
+}
+
+
+static int check_bmp(rs_hnd_t *rh, const VSAPI *vsapi)
+{
+    uint32_t offset_data;
+    bmp_info_header_t info = { 0 };
+
+    char head[10 - 2];          // up to the data offset, after the magic
+
+    if (sizeof(head) != fread(head, 1, sizeof(head), rh->file))
+        return 1;
+
+    if (sizeof(uint32_t) != fread(&offset_data, 1, sizeof(uint32_t), rh->file))
+        return 1;
+
+    if (sizeof(bmp_info_header_t) != fread(&info, 1, sizeof(bmp_info_header_t), rh->file))
+        return 1;
+
+    if (info.num_planes != 1 || info.fourcc != 0 ||
+        (info.bits_per_pixel != 24 && info.bits_per_pixel != 32))
+        return 1;
+
+    rh->vi[0].width = abs_i(info.width);
+    rh->vi[0].height = abs_i(info.height);
+    strcpy(rh->src_format, info.bits_per_pixel == 24 ? "BGR" : "BGRA");
+    rh->off_header = 0;
+    rh->off_frame  = offset_data;
+    rh->row_adjust = 4;
+    rh->flip_v = info.height > 0;   // +height means bmp is bottom-up, must be flipped
+    rh->skip_first_frame_header = 1;// don't re-read the header when the first frame is requested
+
+    VS_LOG(mtDebug, "check_bmp: width=%d height=%d bpp=%d align=%d offset=%d flip_v=%d",
+        (int)info.width, (int)info.height, (int)info.bits_per_pixel,
+        rh->row_adjust, rh->off_header, rh->flip_v);
+
+    return 0;
+}
+
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+// containers are little endian on every host
+static inline uint64_t bswap64(uint64_t v)
+{
+    return ((uint64_t)bswap32((uint32_t)v) << 32) | bswap32((uint32_t)(v >> 32));
+}
+
+
+static void rsz_swap_header(rsz_header_t *hdr)
+{
+    hdr->seek_table = bswap64(hdr->seek_table);
+    hdr->fps_num = (int64_t)bswap64((uint64_t)hdr->fps_num);
+    hdr->fps_den = (int64_t)bswap64((uint64_t)hdr->fps_den);
+    hdr->header_size = bswap32(hdr->header_size);
+    hdr->codec = bswap32(hdr->codec);
+    hdr->width = (int32_t)bswap32((uint32_t)hdr->width);
+    hdr->height = (int32_t)bswap32((uint32_t)hdr->height);
+    hdr->sar_num = (int32_t)bswap32((uint32_t)hdr->sar_num);
+    hdr->sar_den = (int32_t)bswap32((uint32_t)hdr->sar_den);
+    hdr->rowbytes_align = (int32_t)bswap32((uint32_t)hdr->rowbytes_align);
+    hdr->frame_size = bswap32(hdr->frame_size);
+    hdr->num_frames = bswap32(hdr->num_frames);
+    hdr->flags = bswap32(hdr->flags);
+}
+
+
+static void rsz_swap_table(int64_t *table, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        table[i] = (int64_t)bswap64((uint64_t)table[i]);
+}
+#else
+#define rsz_swap_header(hdr)
+#define rsz_swap_table(table, count)
+#endif
+
+
+static int check_rsz(rs_hnd_t *rh, const VSAPI *vsapi)
+{
+    rsz_header_t hdr;
+    size_t len = sizeof(hdr) - rh->magic_size;
+
+    memcpy(hdr.signature, rh->magic, rh->magic_size);
+    if (len != fread(hdr.signature + rh->magic_size, 1, len, rh->file))
+        return 1;
+
+    if (memcmp(hdr.signature, RSZ_SIGNATURE, sizeof(hdr.signature)) != 0)
+        return 1;
+    rsz_swap_header(&hdr);
+
+    if (rh->file_size < 0) {
+        VS_LOG(mtCritical, "check_rsz: compressed containers can't be read from a pipe");
+        return -3;
+    }
+
+    // the table has to fit between its offset and the end of the file
+    if (hdr.header_size < sizeof(hdr) || hdr.num_frames < 1 || hdr.num_frames > INT_MAX ||
+        hdr.seek_table > (uint64_t)rh->file_size ||
+        ((uint64_t)rh->file_size - hdr.seek_table) / sizeof(int64_t) < hdr.num_frames + 1ULL)
+        return -3;
+
+    if (hdr.codec != RSZ_CODEC_NONE
+#ifdef HAVE_LZ4
+        && hdr.codec != RSZ_CODEC_LZ4
+#endif
+#ifdef HAVE_ZSTD
+        && hdr.codec != RSZ_CODEC_ZSTD
+#endif
+        ) {
+        VS_LOG(mtCritical, "check_rsz: codec %u is not supported by this build", hdr.codec);
+        return -3;
+    }
+
+    int64_t *index = (int64_t *)malloc(sizeof(int64_t) * (hdr.num_frames + 1));
+    if (!index)
+        return -3;
+    if (rs_fseek(rh->file, hdr.seek_table, SEEK_SET) != 0 ||
+        fread(index, sizeof(int64_t), hdr.num_frames + 1, rh->file) != hdr.num_frames + 1) {
+        free(index);
+        return -3;
+    }
+    rsz_swap_table(index, hdr.num_frames + 1);
+    uint32_t *index_size = (uint32_t *)malloc(sizeof(uint32_t) * hdr.num_frames);
+    if (!index_size) {
+        free(index);
+        return -3;
+    }
+    for (uint32_t i = 0; i < hdr.num_frames; i++) {
+        if (index[i] < hdr.header_size || index[i + 1] < index[i] ||
+            index[i + 1] - index[i] > hdr.frame_size) {
+            free(index);
+            free(index_size);
+            return -3;
+        }
+        index_size[i] = (uint32_t)(index[i + 1] - index[i]);
+    }
+
+    rh->rsz = 1;
+    rh->codec = hdr.codec;
+    rh->index = index;
+    rh->index_size = index_size;
+    rh->vi[0].numFrames = (int)hdr.num_frames;
+    rh->vi[0].width = hdr.width;
+    rh->vi[0].height = hdr.height;
+    rh->vi[0].fpsNum = hdr.fps_num;
+    rh->vi[0].fpsDen = hdr.fps_den;
+    rh->sar_num = hdr.sar_num;
+    rh->sar_den = hdr.sar_den;
+    rh->row_adjust = hdr.rowbytes_align;
+    rh->flip_v = !!(hdr.flags & RSZ_FLAG_FLIP_V);
+    rh->frame_size = hdr.frame_size;    // checked against the format in init_handler
+    memcpy(rh->src_format, hdr.src_fmt, sizeof(hdr.src_fmt));
+    rh->src_format[FORMAT_MAX_LEN - 1] = 0;
+
+    VS_LOG(mtDebug, "check_rsz: codec=%u frames=%u frame_size=%u",
+        hdr.codec, hdr.num_frames, hdr.frame_size);
+
+    return 0;
+}
+
+
+// single element RGB files, 10-bit filled (packing method A or B) or 16-bit
+static int check_dpx(rs_hnd_t *rh, const VSAPI *vsapi)
+{
+    dpx_header_t hdr;
+    size_t len = sizeof(hdr) - rh->magic_size;
+
+    // check_header has matched all 4 bytes of the magic
+    memcpy(&hdr, rh->magic, rh->magic_size);
+    if (len != fread((char *)&hdr + rh->magic_size, 1, len, rh->file))
+        return 1;
+
+    int big_endian = hdr.magic != DPX_MAGIC;
+
+    dpx_element_t *el = &hdr.element[0];
+    uint32_t width = hdr.pixels_per_line;
+    uint32_t height = hdr.lines_per_element;
+    uint32_t offset = el->data_offset ? el->data_offset : hdr.image_offset;
+    int orientation = hdr.orientation;
+    int num_elements = hdr.num_elements;
+    int packing = el->packing;
+    int encoding = el->encoding;
+    uint32_t eol_padding = el->eol_padding;
+    if (big_endian) {
+        width = bswap32(width);
+        height = bswap32(height);
+        offset = bswap32(el->data_offset ? el->data_offset : hdr.image_offset);
+        orientation = bswap16(hdr.orientation);
+        num_elements = bswap16(hdr.num_elements);
+        packing = bswap16(el->packing);
+        encoding = bswap16(el->encoding);
+        eol_padding = bswap32(el->eol_padding);
+    }
+
+    VS_LOG(mtDebug, "check_dpx: %s endian width=%u height=%u elements=%d descriptor=%d bits=%d packing=%d offset=%u",
+        big_endian ? "big" : "little", width, height, num_elements, el->descriptor,
+        el->bit_size, packing, offset);
+
+    if (num_elements != 1 || el->descriptor != 50 || encoding != 0 ||
+        (orientation != 0 && orientation != 2) ||
+        (eol_padding != 0 && eol_padding != UINT32_MAX) ||
+        width < 1 || width > INT_MAX / 8 || height < 1 || height > INT_MAX ||
+        offset < sizeof(hdr) || offset > INT_MAX) {
+        VS_LOG(mtCritical, "check_dpx: only uncompressed single element RGB is supported");
+        return -4;
+    }
+
+    if (el->bit_size == 10 && packing == 1)
+        strcpy(rh->src_format, big_endian ? "RGB10ABE" : "RGB10A");
+    else if (el->bit_size == 10 && packing == 2)
+        strcpy(rh->src_format, big_endian ? "RGB10BBE" : "RGB10B");
+    else if (el->bit_size == 16)
+        strcpy(rh->src_format, big_endian ? "RGB48BE" : "RGB48LE");
+    else {
+        VS_LOG(mtCritical, "check_dpx: %d-bit packing %d is not supported", el->bit_size, packing);
+        return -4;
+    }
+
+    // a pipe has to be past the header when the first frame is read
+    if (rh->file_size < 0) {
+        char skip[256];
+        for (size_t left = offset - sizeof(hdr); left > 0; ) {
+            size_t n = left < sizeof(skip) ? left : sizeof(skip);
+            if (fread(skip, 1, n, rh->file) != n)
+                return -4;
+            left -= n;
+        }
+    }
+
+    rh->vi[0].width = (int)width;
+    rh->vi[0].height = (int)height;
+    rh->off_header = 0;
+    rh->off_frame = (int)offset;
+    rh->row_adjust = 4;             // lines end on a 32-bit boundary
+    rh->flip_v = orientation == 2;
+    rh->skip_first_frame_header = 1;
+
+    return 0;
+}
+
+
+static int check_header(rs_hnd_t *rh, const VSAPI *vsapi)
+{
+    // read file magic to see what the file type is, if there is
+    // no recognized type then it is raw data
+    rh->magic_size = 2;
+    if (2 != fread(rh->magic, 1, 2, rh->file))
+    {
+        VS_LOG(mtFatal, "check_header: fail to read file magic");
+        return 0;
+    }
+
+    if (strncmp("BM", rh->magic, 2) == 0)
+        return check_bmp(rh, vsapi);
+
+    if (strncmp("YU", rh->magic, 2) == 0)
+        return check_y4m(rh, vsapi);
+
+    if (strncmp("RZ", rh->magic, 2) == 0)
+        return check_rsz(rh, vsapi);
+
+    // DPX is told by all 4 bytes before the rest of its header is read,
+    // raw data starting with "SD" or "XP" keeps them for its first frame
+    if (strncmp("SD", rh->magic, 2) == 0 || strncmp("XP", rh->magic, 2) == 0) {
+        rh->magic_size += (int)fread(rh->magic + 2, 1, 2, rh->file);
+        if (rh->magic_size == 4 &&
+            (memcmp("SDPX", rh->magic, 4) == 0 || memcmp("XPDS", rh->magic, 4) == 0))
+            return check_dpx(rh, vsapi);
+    }
+
+    // these bytes are part of the actual frame and need to be handled
+    rh->write_magic = 1;
+
+    return 1;
+}
+
+
+static const char * VS_CC check_args(rs_hnd_t *rh, vs_args_t *va)
+{
+    const VSAPI* vsapi = va->vsapi;
+
+    const struct {
+        char *format_name;
+        int subsample_h;
+        int subsample_v;
+        int num_planes;
+        int bytes_per_row_sample;
+        int has_alpha;
+        int order[4];
+        VSPresetFormat vsformat;
+        func_write_frame func;
+        func_pack_frame pack;
+    } table[] = {
+        { "YUV9",      4, 4, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV410P8,  write_planar_frame,  pack_planar_frame  },
+        { "YUV410P",   4, 4, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV410P8,  write_planar_frame,  pack_planar_frame  },
+        { "YUV410P8",  4, 4, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV410P8,  write_planar_frame,  pack_planar_frame  },
+        { "YVU9",      4, 4, 3, 1, 0, { 0, 2, 1, 9 }, pfYUV410P8,  write_planar_frame,  pack_planar_frame  },
+
+        { "YUV411P",   4, 1, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV411P8,  write_planar_frame,  pack_planar_frame  },
+        { "YUV411P8",  4, 1, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV411P8,  write_planar_frame,  pack_planar_frame  },
+        { "YV411",     4, 1, 3, 1, 0, { 0, 2, 1, 9 }, pfYUV411P8,  write_planar_frame,  pack_planar_frame  },
+
+        { "i420",      2, 2, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV420P8,  write_planar_frame,  pack_planar_frame  },
+        { "IYUV",      2, 2, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV420P8,  write_planar_frame,  pack_planar_frame  },
+        { "YUV420P",   2, 2, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV420P8,  write_planar_frame,  pack_planar_frame  },
+        { "YUV420P8",  2, 2, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV420P8,  write_planar_frame,  pack_planar_frame  },
+        { "YV12",      2, 2, 3, 1, 0, { 0, 2, 1, 9 }, pfYUV420P8,  write_planar_frame,  pack_planar_frame  },
+        { "YUV420P9",  2, 2, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV420P9,  write_planar_frame,  pack_planar_frame  },
+        { "YUV420P10", 2, 2, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV420P10, write_planar_frame,  pack_planar_frame  },
+        { "YUV420P16", 2, 2, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV420P16, write_planar_frame,  pack_planar_frame  },
+
+        { "NV12",      2, 2, 2, 1, 0, { 0, 1, 2, 9 }, pfYUV420P8,  write_nvxx_frame,    pack_nvxx_frame    },
+        { "NV21",      2, 2, 2, 1, 0, { 0, 2, 1, 9 }, pfYUV420P8,  write_nvxx_frame,    pack_nvxx_frame    },
+
+        { "P010",      2, 2, 2, 2, 0, { 0, 1, 2, 9 }, pfYUV420P16, write_px1x_frame,    pack_px1x_frame    },
+        { "P016",      2, 2, 2, 2, 0, { 0, 1, 2, 9 }, pfYUV420P16, write_px1x_frame,    pack_px1x_frame    },
+
+        { "YUY2",      2, 1, 1, 2, 0, { 0, 1, 0, 2 }, pfYUV422P8,  write_packed_yuv422, pack_packed_yuv422 },
+        { "YUYV",      2, 1, 1, 2, 0, { 0, 1, 0, 2 }, pfYUV422P8,  write_packed_yuv422, pack_packed_yuv422 },
+        { "YUYV422",   2, 1, 1, 2, 0, { 0, 1, 0, 2 }, pfYUV422P8,  write_packed_yuv422, pack_packed_yuv422 },
+        { "YVYU",      2, 1, 1, 2, 0, { 0, 2, 0, 1 }, pfYUV422P8,  write_packed_yuv422, pack_packed_yuv422 },
+        { "YVYU422",   2, 1, 1, 2, 0, { 0, 2, 0, 1 }, pfYUV422P8,  write_packed_yuv422, pack_packed_yuv422 },
+        { "UYVY",      2, 1, 1, 2, 0, { 1, 0, 2, 0 }, pfYUV422P8,  write_packed_yuv422, pack_packed_yuv422 },
+        { "UYVY422",   2, 1, 1, 2, 0, { 1, 0, 2, 0 }, pfYUV422P8,  write_packed_yuv422, pack_packed_yuv422 },
+        { "VYUY",      2, 1, 1, 2, 0, { 2, 0, 1, 0 }, pfYUV422P8,  write_packed_yuv422, pack_packed_yuv422 },
+        { "VYUY422",   2, 1, 1, 2, 0, { 2, 0, 1, 0 }, pfYUV422P8,  write_packed_yuv422, pack_packed_yuv422 },
+
+        { "P210",      2, 1, 2, 2, 0, { 0, 1, 2, 9 }, pfYUV422P16, write_px1x_frame,    pack_px1x_frame    },
+        { "P216",      2, 1, 2, 2, 0, { 0, 1, 2, 9 }, pfYUV422P16, write_px1x_frame,    pack_px1x_frame    },
+        { "Y210",      2, 1, 1, 4, 0, { 0, 1, 0, 2 }, pfYUV422P16, write_packed_yuv422_16, pack_packed_yuv422_16 },
+        { "Y216",      2, 1, 1, 4, 0, { 0, 1, 0, 2 }, pfYUV422P16, write_packed_yuv422_16, pack_packed_yuv422_16 },
+
+        { "i422",      2, 1, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV422P8,  write_planar_frame,  pack_planar_frame  },
+        { "YUV422P",   2, 1, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV422P8,  write_planar_frame,  pack_planar_frame  },
+        { "YUV422P8",  2, 1, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV422P8,  write_planar_frame,  pack_planar_frame  },
+        { "YV16",      2, 1, 3, 1, 0, { 0, 2, 1, 9 }, pfYUV422P8,  write_planar_frame,  pack_planar_frame  },
+        { "YUV422P9",  2, 1, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV422P9,  write_planar_frame,  pack_planar_frame  },
+        { "YUV422P10", 2, 1, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV422P10, write_planar_frame,  pack_planar_frame  },
+        { "YUV422P16", 2, 1, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV422P16, write_planar_frame,  pack_planar_frame  },
+
+
+        { "YUV440P",   1, 2, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV440P8,  write_planar_frame,  pack_planar_frame  },
+        { "YUV440P8",  1, 2, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV440P8,  write_planar_frame,  pack_planar_frame  },
+
+        { "Y8",        1, 1, 1, 1, 0, { 0, 9, 9, 9 }, pfGray8,     write_planar_frame,  pack_planar_frame  },
+        { "Y800",      1, 1, 1, 1, 0, { 0, 9, 9, 9 }, pfGray8,     write_planar_frame,  pack_planar_frame  },
+        { "GRAY",      1, 1, 1, 1, 0, { 0, 9, 9, 9 }, pfGray8,     write_planar_frame,  pack_planar_frame  },
+        { "GRAY16",    1, 1, 1, 2, 0, { 0, 9, 9, 9 }, pfGray16,    write_planar_frame,  pack_planar_frame  },
+        { "GRAYH",     1, 1, 1, 2, 0, { 0, 9, 9, 9 }, pfGrayH,     write_planar_frame,  pack_planar_frame  },
+        { "GRAYS",     1, 1, 1, 4, 0, { 0, 9, 9, 9 }, pfGrayS,     write_planar_frame,  pack_planar_frame  },
+
+        { "RAW10",     4, 1, 1, 2, 0, { 0, 9, 9, 9 }, pfGray16,    write_mipi_raw10,    pack_mipi_raw10    },
+        { "Y10P",      4, 1, 1, 2, 0, { 0, 9, 9, 9 }, pfGray16,    write_mipi_raw10,    pack_mipi_raw10    },
+        { "SRGGB10P",  4, 2, 1, 2, 0, { 0, 9, 9, 9 }, pfGray16,    write_mipi_raw10,    pack_mipi_raw10    },
+        { "SBGGR10P",  4, 2, 1, 2, 0, { 0, 9, 9, 9 }, pfGray16,    write_mipi_raw10,    pack_mipi_raw10    },
+        { "SGBRG10P",  4, 2, 1, 2, 0, { 0, 9, 9, 9 }, pfGray16,    write_mipi_raw10,    pack_mipi_raw10    },
+        { "SGRBG10P",  4, 2, 1, 2, 0, { 0, 9, 9, 9 }, pfGray16,    write_mipi_raw10,    pack_mipi_raw10    },
+        { "RAW12",     2, 1, 1, 2, 0, { 0, 9, 9, 9 }, pfGray16,    write_mipi_raw12,    pack_mipi_raw12    },
+        { "Y12P",      2, 1, 1, 2, 0, { 0, 9, 9, 9 }, pfGray16,    write_mipi_raw12,    pack_mipi_raw12    },
+        { "SRGGB12P",  2, 2, 1, 2, 0, { 0, 9, 9, 9 }, pfGray16,    write_mipi_raw12,    pack_mipi_raw12    },
+        { "SBGGR12P",  2, 2, 1, 2, 0, { 0, 9, 9, 9 }, pfGray16,    write_mipi_raw12,    pack_mipi_raw12    },
+        { "SGBRG12P",  2, 2, 1, 2, 0, { 0, 9, 9, 9 }, pfGray16,    write_mipi_raw12,    pack_mipi_raw12    },
+        { "SGRBG12P",  2, 2, 1, 2, 0, { 0, 9, 9, 9 }, pfGray16,    write_mipi_raw12,    pack_mipi_raw12    },
+
+        { "i444",      1, 1, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV444P8,  write_planar_frame,  pack_planar_frame  },
+        { "YUV444P",   1, 1, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV444P8,  write_planar_frame,  pack_planar_frame  },
+        { "YUV444P8",  1, 1, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV444P8,  write_planar_frame,  pack_planar_frame  },
+        { "YV24",      1, 1, 3, 1, 0, { 0, 2, 1, 9 }, pfYUV444P8,  write_planar_frame,  pack_planar_frame  },
+        { "YUV444P9",  1, 1, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV444P9,  write_planar_frame,  pack_planar_frame  },
+        { "YUV444P10", 1, 1, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV444P10, write_planar_frame,  pack_planar_frame  },
+        { "YUV444P16", 1, 1, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV444P16, write_planar_frame,  pack_planar_frame  },
+        { "YUV444PS",  1, 1, 3, 4, 0, { 0, 1, 2, 9 }, pfYUV444PS,  write_planar_frame,  pack_planar_frame  },
+        { "YUV444P8A", 1, 1, 4, 1, 1, { 0, 1, 2, 3 }, pfYUV444P8,  write_planar_frame,  pack_planar_frame  },
+
+        { "BGR",       1, 1, 1, 3, 0, { 2, 1, 0, 9 }, pfRGB24,     write_packed_rgb24,  pack_packed_rgb24  },
+        { "BGR24",     1, 1, 1, 3, 0, { 2, 1, 0, 9 }, pfRGB24,     write_packed_rgb24,  pack_packed_rgb24  },
+        { "RGB",       1, 1, 1, 3, 0, { 0, 1, 2, 9 }, pfRGB24,     write_packed_rgb24,  pack_packed_rgb24  },
+        { "RGB24",     1, 1, 1, 3, 0, { 0, 1, 2, 9 }, pfRGB24,     write_packed_rgb24,  pack_packed_rgb24  },
+
+        { "BGRA",      1, 1, 1, 4, 1, { 2, 1, 0, 3 }, pfRGB24,     write_packed_rgb32,  pack_packed_rgb32  },
+        { "ABGR",      1, 1, 1, 4, 1, { 3, 2, 1, 0 }, pfRGB24,     write_packed_rgb32,  pack_packed_rgb32  },
+        { "RGBA",      1, 1, 1, 4, 1, { 0, 1, 2, 3 }, pfRGB24,     write_packed_rgb32,  pack_packed_rgb32  },
+        { "ARGB",      1, 1, 1, 4, 1, { 3, 0, 1, 2 }, pfRGB24,     write_packed_rgb32,  pack_packed_rgb32  },
+        { "AYUV",      1, 1, 1, 4, 1, { 3, 0, 1, 2 }, pfYUV444P8,  write_packed_rgb32,  pack_packed_rgb32  },
+        { "UYVA",      1, 1, 1, 4, 1, { 1, 0, 2, 3 }, pfYUV444P8,  write_packed_rgb32,  pack_packed_rgb32  },
+        { "VUYA",      1, 1, 1, 4, 1, { 2, 1, 0, 3 }, pfYUV444P8,  write_packed_rgb32,  pack_packed_rgb32  },
+        { "v410",      1, 1, 1, 4, 0, { 2, 0, 1, 9 }, pfYUV444P10, write_rgb10a_le,     pack_rgb10a_le     },
+        { "Y410",      1, 1, 1, 4, 1, { 2, 0, 1, 9 }, pfYUV444P10, write_rgb10b_le,     pack_rgb10b_le     },
+        { "Y416",      1, 1, 1, 8, 1, { 1, 0, 2, 3 }, pfYUV444P16, write_packed_rgb64,  pack_packed_rgb64  },
+
+        { "GBRP8",     1, 1, 3, 1, 0, { 1, 2, 0, 9 }, pfRGB24,     write_planar_frame,  pack_planar_frame  },
+        { "GBRP",      1, 1, 3, 1, 0, { 1, 2, 0, 9 }, pfRGB24,     write_planar_frame,  pack_planar_frame  },
+        { "RGBP",      1, 1, 3, 1, 0, { 0, 1, 2, 9 }, pfRGB24,     write_planar_frame,  pack_planar_frame  },
+        { "RGBP8",     1, 1, 3, 1, 0, { 0, 1, 2, 9 }, pfRGB24,     write_planar_frame,  pack_planar_frame  },
+
+        { "GBRP9",     1, 1, 3, 2, 0, { 1, 2, 0, 9 }, pfRGB27,     write_planar_frame,  pack_planar_frame  },
+        { "RGBP9",     1, 1, 3, 2, 0, { 0, 1, 2, 9 }, pfRGB27,     write_planar_frame,  pack_planar_frame  },
+        { "GBRP10",    1, 1, 3, 2, 0, { 1, 2, 0, 9 }, pfRGB30,     write_planar_frame,  pack_planar_frame  },
+        { "RGBP10",    1, 1, 3, 2, 0, { 0, 1, 2, 9 }, pfRGB30,     write_planar_frame,  pack_planar_frame  },
+        { "GBRP16",    1, 1, 3, 2, 0, { 1, 2, 0, 9 }, pfRGB48,     write_planar_frame,  pack_planar_frame  },
+        { "RGBP16",    1, 1, 3, 2, 0, { 0, 1, 2, 9 }, pfRGB48,     write_planar_frame,  pack_planar_frame  },
+        { "BGR48",     1, 1, 3, 2, 0, { 2, 1, 0, 3 }, pfRGB48,     write_packed_rgb48,  pack_packed_rgb48  },
+        { "RGB48",     1, 1, 3, 2, 0, { 0, 1, 2, 3 }, pfRGB48,     write_packed_rgb48,  pack_packed_rgb48  },
+        { "RGB48LE",   1, 1, 1, 6, 0, { 0, 1, 2, 9 }, pfRGB48,     write_packed_rgb48,  pack_packed_rgb48  },
+        { "RGB48BE",   1, 1, 1, 6, 0, { 0, 1, 2, 9 }, pfRGB48,     write_packed_rgb48be, pack_packed_rgb48be },
+        { "RGBF16",    1, 1, 1, 6, 0, { 0, 1, 2, 9 }, pfRGBH,      write_packed_rgb48,  pack_packed_rgb48  },
+        { "RGBAF16",   1, 1, 1, 8, 1, { 0, 1, 2, 3 }, pfRGBH,      write_packed_rgb64,  pack_packed_rgb64  },
+        { "RGBF32",    1, 1, 1, 12, 0, { 0, 1, 2, 9 }, pfRGBS,     write_packed_rgb96,  pack_packed_rgb96  },
+        { "RGBAF32",   1, 1, 1, 16, 1, { 0, 1, 2, 3 }, pfRGBS,     write_packed_rgb128, pack_packed_rgb128 },
+
+        { "RGB10A",    1, 1, 1, 4, 0, { 0, 1, 2, 9 }, pfRGB30,     write_rgb10a_le,     pack_rgb10a_le     },
+        { "RGB10ABE",  1, 1, 1, 4, 0, { 0, 1, 2, 9 }, pfRGB30,     write_rgb10a_be,     pack_rgb10a_be     },
+        { "R10K",      1, 1, 1, 4, 0, { 0, 1, 2, 9 }, pfRGB30,     write_rgb10a_be,     pack_rgb10a_be     },
+        { "RGB10B",    1, 1, 1, 4, 0, { 0, 1, 2, 9 }, pfRGB30,     write_rgb10b_le,     pack_rgb10b_le     },
+        { "RGB10BBE",  1, 1, 1, 4, 0, { 0, 1, 2, 9 }, pfRGB30,     write_rgb10b_be,     pack_rgb10b_be     },
+        { "R210",      1, 1, 1, 4, 0, { 0, 1, 2, 9 }, pfRGB30,     write_rgb10b_be,     pack_rgb10b_be     },
+        { rh->src_format, 0 }
+    };
+
+    int i = 0;
+    while (strcasecmp(rh->src_format, table[i].format_name) != 0)
+        i++;
+
+    if (table[i].vsformat == 0)
+        return "unsupported format";
+
+    if (rh->vi[0].width % table[i].subsample_h != 0)
+        return "invalid width was specified";
+
+    if (rh->vi[0].height % table[i].subsample_v != 0)
+        return "invalid height was specified";
+
+    // rows are addressed with int, frames are only limited by the address space
+    if ((int64_t)rh->vi[0].width * 2 * table[i].bytes_per_row_sample > INT_MAX - 16)
+        return "invalid width was specified";
+
+    // MIPI packing isn't a whole number of bytes per pixel, and its formats
+    // are 10 and 12 bits
+    int mipi_bits = table[i].func == write_mipi_raw10 ? 10 :
+                    table[i].func == write_mipi_raw12 ? 12 : 0;
+
+    uint64_t frame_size = 0;
+    if (mipi_bits) {
+        int row_size = (mipi_row_bytes(rh->vi[0].width, mipi_bits) + rh->row_adjust) &
+                       (~rh->row_adjust);
+        frame_size = (uint64_t)row_size * rh->vi[0].height;
+    }
+    for (int p = 0; !mipi_bits && p < table[i].num_planes; p++) {
+        int width_plane =
+            (rh->vi[0].width / (p ? table[i].subsample_h : 1)) << (table[i].num_planes == 2 && p ? 1 : 0);
+        int height_plane = rh->vi[0].height / (p ? table[i].subsample_v : 1);
+        int row_size_plane =
+            (width_plane * table[i].bytes_per_row_sample + rh->row_adjust) & (~rh->row_adjust);
+        frame_size += (uint64_t)row_size_plane * height_plane;
+    }
+    if (frame_size > SIZE_MAX - 4096)
+        return "frame is too large for this platform";
+
+    rh->frame_size = frame_size;
+    rh->vi[0].format = mipi_bits ?
+        va->vsapi->registerFormat(cmGray, stInteger, mipi_bits, 0, 0, va->core) :
+        va->vsapi->getFormatPreset(table[i].vsformat, va->core);
+    memcpy(rh->order, table[i].order, sizeof(int) * 4);
+    rh->write_frame = table[i].func;
+    rh->pack_frame = table[i].pack;
+    rh->has_alpha = table[i].has_alpha;
+
+    VS_LOG(mtDebug, "check_args: src_format=%s dst_format=%s size=%dx%d alpha=%d frame_size=%" PRIu64 " off_header=%d off_frame=%d",
+        table[i].format_name, rh->vi[0].format->name, rh->vi[0].width, rh->vi[0].height, rh->has_alpha,
+        frame_size, rh->off_header, rh->off_frame);
+
+    return NULL;
+}
+
+
+static void
+history_free(rs_history_t* node, const VSAPI *vsapi)
+{
+    if (node->next)
+        history_free(node->next, vsapi);
+
+    for (int i = 0; i < 2; i++) {
+        if (node->frame[i])
+            vsapi->freeFrame(node->frame[i]);
+    }
+    free(node);
+}
+
+static void
+history_add(rs_hnd_t* rh, int frameNumber, VSFrameRef** frames, const VSAPI *vsapi)
+{
+    // note: before this is called we already determined frame
+    // was *not* in the history, no check for that here
+
+    rs_history_t* h = (rs_history_t*)calloc(1, sizeof(*h));
+    if (!h)
+        return;
+    h->frameNumber = frameNumber;
+    for (int i = 0; i < 2; i++) {
+        if (frames[i])
+            h->frame[i] = vsapi->cloneFrameRef(frames[i]);
+    }
+
+    if (rh->history)
+    {
+        rs_history_t* node = rh->history;
+        int length = 1;
+        while (node->next)
+        {
+            length++;
+            node = node->next;
+        }
+        node->next = h;
+
+        if (length > 16)
+        {
+            rs_history_t* del = rh->history;
+            rh->history = del->next;
+            del->next = NULL;
+            history_free(del, vsapi);
+        }
+    }
+    else
+    {
+        rh->history = h;
+    }
+}
+
+static const VSFrameRef* history_get(const rs_hnd_t* rh, int frameNumber, int index)
+{
+    const VSFrameRef* frame = NULL;
+
+    rs_history_t* node = rh->history;
+    while (node)
+    {
+        if (node->frameNumber == frameNumber)
+        {
+            frame = node->frame[index];
+            break;
+        }
+        node = node->next;
+    }
+
+    return frame;
+}
+
+
+static void close_handler(rs_hnd_t *rh)
+{
+    if (!rh) {
+        return;
+    }
+    if (rh->frame_buff) {
+        free_buffer(rh->frame_buff, rh->frame_buff_mapped);
+    }
+    if (rh->index) {
+        free(rh->index);
+    }
+    free(rh->index_size);
+    free(rh->manifest);
+#ifdef RS_HAVE_PREADV
+    if (rh->iov) {
+        free(rh->iov);
+    }
+#endif
+    free(rh->span_scratch);
+    free(rh->opaque_row);
+#ifdef RS_HAVE_PIPE_FD
+    if (rh->reader) {
+        close_pipe_reader(rh->reader);
+    }
+#endif
+    if (rh->file) {
+        fclose(rh->file);
+    }
+#ifdef RS_HAVE_SHM
+    if (rh->shm) {
+        munmap(rh->shm, rh->shm_size);
+    }
+#endif
+    if (rh->spool) {
+        fclose(rh->spool);
+    }
+    for (int i = 0; i < RS_POOL_SIZE; i++) {
+        if (rh->pool[i].file)
+            fclose(rh->pool[i].file);
+    }
+    for (int i = 1; i < 4; i++) {
+        if (rh->plane_file[i])
+            fclose(rh->plane_file[i]);
+    }
+    if (rh->segment_name) {
+        for (int i = 0; i < rh->num_segments; i++)
+            free(rh->segment_name[i]);
+        free(rh->segment_name);
+    }
+    free(rh->segment_size);
+    free(rh->index_segment);
+    rs_mutex_destroy(&rh->lock);
+    free(rh);
+}
+
+
+static void VS_CC
+vs_close(void *instance_data, VSCore *core, const VSAPI *vsapi)
+{
+    rs_hnd_t *rh = (rs_hnd_t *)instance_data;
+    if (rh->history)
+        history_free(rh->history, vsapi);
+    close_handler(rh);
+}
+
+
+// format and size of the clips handed out, after crop and plane selection
+static void output_info(const rs_hnd_t *rh, VSVideoInfo *vi)
+{
+    for (int i = 0; i < 2; i++) {
+        vi[i] = rh->vi[i];
+        vi[i].width = rh->crop_width;
+        vi[i].height = rh->crop_height;
+    }
+
+    if (rh->plane > 0) {
+        vi[0].width >>= rh->vi[0].format->subSamplingW;
+        vi[0].height >>= rh->vi[0].format->subSamplingH;
+    }
+    vi[0].format = rh->plane >= 0 ? rh->plane_format : rh->out_format;
+}
+
+
+static void VS_CC
+vs_init(VSMap *in, VSMap *out, void **instance_data, VSNode *node,
+        VSCore *core, const VSAPI *vsapi)
+{
+    rs_hnd_t *rh = (rs_hnd_t *)*instance_data;
+    VSVideoInfo vi[2];
+    output_info(rh, vi);
+    vsapi->setVideoInfo(vi, rh->has_alpha + 1, node);
+}
+
+// position the source at the raw data of frame n. returns the file to read
+// it from, *magic is the number of its bytes the header probe has already
+// consumed, which are in rh->magic
+static FILE *seek_frame(rs_hnd_t *rh, int n, size_t *magic, const VSAPI *vsapi)
+{
+    FILE *file = rh->file;
+    *magic = 0;
+
+    if (rh->index) {
+        // file: seek to just after the frame header
+        int frame_number = n;
+        if (n >= rh->vi[0].numFrames)
+            frame_number = rh->vi[0].numFrames - 1;
+
+        file = frame_file(rh, frame_number, vsapi);
+        if (!file || rs_fseek(file, rh->index[frame_number], SEEK_SET) != 0)
+            return NULL;
+    }
+    else if (rh->off_frame > 0 && !(n==0 && rh->skip_first_frame_header)) {
+        // pipe: read off frame header, which can be larger than frame_buff
+        // todo: non-sequential access check
+        for (size_t left = rh->off_frame; left > 0; ) {
+            size_t len = left < rh->frame_buff_size ? left : rh->frame_buff_size;
+            if (len != read_pipe(rh, rh->frame_buff, len))
+            {
+                VS_LOG(mtCritical, "read frame header failed at frame %d", n);
+                return NULL;
+            }
+            left -= len;
+        }
+    }
+    else if (rh->off_frame == 0 && n == 0 && rh->write_magic)
+    {
+        // pipe: first frame needs to include magic bytes
+        *magic = rh->magic_size;
+    }
+
+    return file;
+}
+
+// read the raw data of frame n into rh->frame_buff
+static int VS_CC read_frame(rs_hnd_t *rh, int n, const VSAPI *vsapi)
+{
+    size_t magic;
+    FILE *file = seek_frame(rh, n, &magic, vsapi);
+    if (!file)
+        return -1;
+
+    memcpy(rh->frame_buff, rh->magic, magic);
+    size_t read_len = rh->frame_size - magic;
+    size_t len = rh->index ? fread(rh->frame_buff + magic, 1, read_len, file)
+                           : read_pipe(rh, rh->frame_buff + magic, read_len);
+    if (len < read_len)
+    {
+         VS_LOG(mtCritical, "read frame failed at frame %d", n);
+         return -1;
+    }
+
+    return 0;
+}
+
+
+// bytes per source row of the converters that make every output row from a
+// single source row, so that their frames can be streamed. 0 for others
+static int stripe_stride(const rs_hnd_t *rh)
+{
+    func_write_frame f = rh->write_frame;
+    int bpp = f == write_packed_yuv422 ? 2 :
+              f == write_packed_yuv422_16 ? 4 :
+              f == write_packed_rgb24 ? 3 :
+              f == write_packed_rgb48 || f == write_packed_rgb48be ? 6 :
+              f == write_packed_rgb64 ? 8 :
+              f == write_packed_rgb96 ? 12 :
+              f == write_packed_rgb128 ? 16 :
+              f == write_packed_rgb32 || f == write_rgb10a_le || f == write_rgb10a_be ||
+              f == write_rgb10b_le || f == write_rgb10b_be ? 4 : 0;
+    int row_bytes = f == write_mipi_raw10 ? mipi_row_bytes(rh->vi[0].width, 10) :
+                    f == write_mipi_raw12 ? mipi_row_bytes(rh->vi[0].width, 12) :
+                    rh->vi[0].width * bpp;
+    int stride = (row_bytes + rh->row_adjust) & (~rh->row_adjust);
+    return row_bytes && (uint64_t)stride * rh->vi[0].height == rh->frame_size ? stride : 0;
+}
+
+
+#define STRIPE_SIZE (256 << 10)    // fits the L2 cache along with the rows written
+
+// read frame n a stripe of rows at a time into rh->frame_buff and convert
+// every stripe while it is still in cache. files are asked to read the next
+// stripe ahead, pipes keep filling their buffer meanwhile
+static int VS_CC
+read_frame_striped(rs_hnd_t *rh, int n, VSFrameRef **dst, const rs_rows_t *write_rows,
+                   uint32_t *crc, const VSAPI *vsapi, VSCore *core)
+{
+    size_t magic;
+    FILE *file = seek_frame(rh, n, &magic, vsapi);
+    if (!file)
+        return -1;
+
+    int height = rh->vi[0].height;
+    int stride = stripe_stride(rh);
+    rs_rows_t rows = { 0 };
+    if (write_rows)
+        rows = *write_rows;
+
+    for (int y = 0; y < height; y += rh->stripe_rows) {
+        int count = height - y < rh->stripe_rows ? height - y : rh->stripe_rows;
+        size_t read_len = (size_t)count * stride - magic;
+        memcpy(rh->frame_buff, rh->magic, magic);
+        size_t len = rh->index ? fread(rh->frame_buff + magic, 1, read_len, file)
+                               : read_pipe(rh, rh->frame_buff + magic, read_len);
+        if (len < read_len) {
+            VS_LOG(mtCritical, "read frame failed at frame %d", n);
+            return -1;
+        }
+        magic = 0;
+#if defined(RS_HAVE_PREADV) && defined(POSIX_FADV_WILLNEED)
+        if (rh->index && y + count < height)
+            posix_fadvise(fileno(file), rs_ftell(file),
+                          (off_t)rh->stripe_rows * stride, POSIX_FADV_WILLNEED);
+#endif
+        if (crc)
+            *crc = crc32c(*crc, rh->frame_buff, (size_t)count * stride);
+
+        // source rows y~y+count-1, mirrored in the output if stored bottom-up
+        rows.src_y = y;
+        rows.y_begin = rh->flip_v ? height - y - count : y;
+        rows.y_end = rows.y_begin + count;
+        rh->write_frame(rh, rh->frame_buff, dst, &rows, vsapi, core);
+    }
+
+    return 0;
+}
+
+// replace the whole frames in dst with the region being output
+static void VS_CC
+extract_region(const rs_hnd_t *rh, VSFrameRef **dst, rs_stats_t *stats, const VSAPI *vsapi,
+               VSCore *core)
+{
+    VSVideoInfo vi[2];
+    output_info(rh, vi);
+
+    for (int i = 0; i < 2 && dst[i]; i++) {
+        const VSFormat *fmt = vsapi->getFrameFormat(dst[i]);
+        VSFrameRef *region = vsapi->newVideoFrame(vi[i].format, vi[i].width, vi[i].height,
+                                                  NULL, core);
+
+        for (int p = 0; p < vi[i].format->numPlanes; p++) {
+            int plane = i == 0 && rh->plane >= 0 ? rh->plane : p;
+            int ssw = plane ? fmt->subSamplingW : 0;
+            int ssh = plane ? fmt->subSamplingH : 0;
+            int src_stride = vsapi->getStride(dst[i], plane);
+            int dst_stride = vsapi->getStride(region, p);
+            int row_size = (rh->crop_width >> ssw) * fmt->bytesPerSample;
+            int height = rh->crop_height >> ssh;
+            const uint8_t *srcp = vsapi->getReadPtr(dst[i], plane) +
+                                  (size_t)(rh->crop_top >> ssh) * src_stride +
+                                  (rh->crop_left >> ssw) * fmt->bytesPerSample;
+            uint8_t *dstp = vsapi->getWritePtr(region, p);
+            rs_stats_t *st = i == 0 && stats && stats[p].bytes ? &stats[p] : NULL;
+            for (int y = 0; y < height; y++) {
+                memcpy(dstp, srcp, row_size);
+                if (st)
+                    stats_row(st, dstp, rh->crop_width >> ssw);
+                srcp += src_stride;
+                dstp += dst_stride;
+            }
+        }
+
+        vsapi->freeFrame(dst[i]);
+        dst[i] = region;
+    }
+}
+
+// pipe with spool: frames are copied to the spool file as they arrive,
+// so anything received so far can be read again into rh->frame_buff
+static int VS_CC read_spooled_frame(rs_hnd_t *rh, int n, const VSAPI *vsapi)
+{
+    while (rh->spooled <= n && !rh->spool_eof) {
+        if (pipe_eof(rh)) {
+            rh->spool_eof = 1;
+            VS_LOG(mtDebug, "pipe ended after %d frames", rh->spooled);
+            break;
+        }
+
+        if (read_frame(rh, rh->spooled, vsapi) != 0)
+            return -1;
+
+        int slot = rh->spool_frames ? rh->spooled % rh->spool_frames : rh->spooled;
+        if (rs_fseek(rh->spool, (int64_t)slot * rh->frame_size, SEEK_SET) != 0 ||
+            fwrite(rh->frame_buff, 1, rh->frame_size, rh->spool) != rh->frame_size) {
+            VS_LOG(mtCritical, "failed to write frame %d to the spool", rh->spooled);
+            return -1;
+        }
+        rh->spooled++;
+        if (rh->spooled > n)
+            return 0;   // just read, frame_buff holds it already
+    }
+
+    if (rh->spooled == 0) {
+        VS_LOG(mtCritical, "pipe ended before the first frame");
+        return -1;
+    }
+
+    // past the end of the pipe, repeat the last frame like files do
+    if (n >= rh->spooled)
+        n = rh->spooled - 1;
+
+    if (rh->spool_frames && n < rh->spooled - rh->spool_frames) {
+        VS_LOG(mtCritical, "frame %d has already left the spool, oldest is %d",
+               n, rh->spooled - rh->spool_frames);
+        return -1;
+    }
+
+    int slot = rh->spool_frames ? n % rh->spool_frames : n;
+    if (rs_fseek(rh->spool, (int64_t)slot * rh->frame_size, SEEK_SET) != 0 ||
+        fread(rh->frame_buff, 1, rh->frame_size, rh->spool) != rh->frame_size) {
+        VS_LOG(mtCritical, "failed to read frame %d from the spool", n);
+        return -1;
+    }
+
+    return 0;
+}
+
+// shm: map a frame ring and take its format from the ring header
+static const char *open_shm(rs_hnd_t *rh, const char *name)
+{
+#ifdef RS_HAVE_SHM
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) {
+        return "source does not exist.";
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof(rs_shm_header_t)) {
+        close(fd);
+        return "invalid shared memory ring was found";
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return "failed to map shared memory ring";
+    }
+    rh->shm = (rs_shm_header_t *)map;
+    rh->shm_size = st.st_size;
+
+    // the slots have to fit after data_offset, checked by division so that
+    // a corrupt header can't overflow the sum
+    const rs_shm_header_t *hdr = rh->shm;
+    uint64_t size = (uint64_t)st.st_size;
+    if (memcmp(hdr->signature, RS_SHM_SIGNATURE, sizeof(hdr->signature)) != 0 ||
+        hdr->header_size < sizeof(*hdr) || hdr->num_slots == 0 ||
+        hdr->data_offset < hdr->header_size + sizeof(uint32_t) * (uint64_t)hdr->num_slots ||
+        hdr->data_offset > size ||
+        hdr->slot_size > (size - hdr->data_offset) / hdr->num_slots ||
+        hdr->width < 1 || hdr->height < 1 || hdr->fps_num < 1 || hdr->fps_den < 1) {
+        return "invalid shared memory ring was found";
+    }
+
+    rh->file_size = -1;
+    rh->vi[0].width = hdr->width;
+    rh->vi[0].height = hdr->height;
+    rh->vi[0].fpsNum = hdr->fps_num;
+    rh->vi[0].fpsDen = hdr->fps_den;
+    rh->sar_num = hdr->sar_num;
+    rh->sar_den = hdr->sar_den;
+    rh->row_adjust = hdr->rowbytes_align;
+    memcpy(rh->src_format, hdr->src_fmt, sizeof(hdr->src_fmt));
+    rh->src_format[FORMAT_MAX_LEN - 1] = 0;
+    rh->shm->reader_pid = (int32_t)getpid();
+    return NULL;
+#else
+    return "shm: sources are not supported on this platform";
+#endif
+}
+
+
+#ifdef RS_HAVE_SHM
+static uint32_t *shm_slot_seq(const rs_hnd_t *rh)
+{
+    return (uint32_t *)((uint8_t *)rh->shm + rh->shm->header_size);
+}
+
+
+static const uint8_t *shm_slot(const rs_hnd_t *rh, int n)
+{
+    return (uint8_t *)rh->shm + rh->shm->data_offset +
+           (uint64_t)(n % rh->shm->num_slots) * rh->shm->slot_size;
+}
+
+
+// let the producer reuse the slots of the frames before n
+static void shm_release(rs_hnd_t *rh, int n)
+{
+    if (n <= 0 || (uint32_t)n <= __atomic_load_n(&rh->shm->read_seq, __ATOMIC_ACQUIRE))
+        return;
+    __atomic_store_n(&rh->shm->read_seq, (uint32_t)n, __ATOMIC_RELEASE);
+    syscall(SYS_futex, &rh->shm->read_seq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+
+// wait until frame n is in the ring. *frame_number is the frame served,
+// the last one once the producer is done, or -1 if the ring has no frame
+static const uint8_t *read_shm_frame(rs_hnd_t *rh, int n, int *frame_number,
+                                     const VSAPI *vsapi)
+{
+    rs_shm_header_t *hdr = rh->shm;
+
+    // frame n can only be written once the slot it goes to is free
+    shm_release(rh, n + 1 - (int)hdr->num_slots);
+
+    uint32_t seq;
+    while ((seq = __atomic_load_n(&hdr->write_seq, __ATOMIC_ACQUIRE)) <= (uint32_t)n &&
+           !hdr->eof) {
+        if (kill(hdr->producer_pid, 0) != 0 && errno == ESRCH) {
+            VS_LOG(mtWarning, "shm producer %d has gone away", hdr->producer_pid);
+            break;
+        }
+        struct timespec ts = { 0, 100 * 1000 * 1000 };
+        syscall(SYS_futex, &hdr->write_seq, FUTEX_WAIT, seq, &ts, NULL, 0);
+    }
+    seq = __atomic_load_n(&hdr->write_seq, __ATOMIC_ACQUIRE);
+
+    if (seq == 0) {
+        VS_LOG(mtCritical, "shm ring ended before the first frame");
+        return NULL;
+    }
+
+    // past the end of the ring, repeat the last frame like files do
+    *frame_number = (uint32_t)n < seq ? n : (int)seq - 1;
+    if (__atomic_load_n(&shm_slot_seq(rh)[*frame_number % hdr->num_slots],
+                        __ATOMIC_ACQUIRE) != (uint32_t)*frame_number + 1) {
+        VS_LOG(mtCritical, "frame %d has already left the shm ring", *frame_number);
+        return NULL;
+    }
+    return shm_slot(rh, *frame_number);
+}
+
+
+// check that the slot wasn't reused while it was being converted, then keep
+// the newest half of the ring for frames requested again
+static int end_shm_frame(rs_hnd_t *rh, int frame_number, const VSAPI *vsapi)
+{
+    uint32_t seq = __atomic_load_n(&shm_slot_seq(rh)[frame_number % rh->shm->num_slots],
+                                   __ATOMIC_ACQUIRE);
+    shm_release(rh, frame_number + 1 - (int)rh->shm->num_slots / 2);
+    if (seq != (uint32_t)frame_number + 1) {
+        VS_LOG(mtCritical, "frame %d was overwritten in the shm ring", frame_number);
+        return -1;
+    }
+    return 0;
+}
+#endif
+
+
+static const VSFrameRef * VS_CC
+rs_get_frame(int n, int activation_reason, void **instance_data,
+             void **frame_data, VSFrameContext *frame_ctx, VSCore *core,
+             const VSAPI *vsapi)
+{
+    if (activation_reason != arInitial)
+        return NULL;
+
+    rs_hnd_t *rh = (rs_hnd_t *)*instance_data;
+
+    int index = rh->has_alpha ? vsapi->getOutputIndex(frame_ctx) : 0;
+
+    // try to get frame from history. both clips of a frame are decoded
+    // together, so a request for either one is served from the same entry
+    rs_mutex_lock(&rh->lock);
+    const VSFrameRef *ref = history_get(rh, n, index);
+    if (ref)
+        ref = vsapi->cloneFrameRef(ref);
+    rs_mutex_unlock(&rh->lock);
+    if (ref)
+        return ref;
+
+    VSFrameRef *dst[2] = {NULL};
+    uint32_t crc = 0;
+
+    VSVideoInfo vi[2];
+    output_info(rh, vi);
+    rs_stats_t stats[3] = {{0}};
+    if (rh->stats && stats_init(stats, vi[0].format, rh->stats == 2) != 0) {
+        stats_free(stats, 3);
+        VS_LOG(mtCritical, "failed to allocate histogram at frame %d", n);
+        return NULL;
+    }
+
+    // the converters change the format and measure the planes as they write
+    // them, unless only a region of their output is kept. planes read
+    // straight from the file get the same work in one pass afterwards.
+    // only a region read has the rows of the output frame, the others
+    // are whole frames
+    int read_planes = rh->region_read || rh->direct_read || rh->plane_files;
+    rs_rows_t rows;
+    rows_init(&rows, rh, rh->stats && (rh->region_read || !rh->region) ? stats : NULL,
+              rh->region_read);
+    const rs_rows_t *write_rows = rows.in_bytes || rows.stats ? &rows : NULL;
+
+    // pipe: detect out-of-order frame requests, which are possible
+    // if vspipe --requests > 1. every source keeps its own count
+    if (!rh->index && !rh->spool && !rh->shm) {
+        if (n != rh->last_frame_number + 1)
+            VS_LOG(mtCritical, "seeking a pipe is unsupported: need frame %d, requested %d",
+                rh->last_frame_number + 1, n);
+        rh->last_frame_number = n;
+    }
+
+    if (rh->follow && n >= rh->index_frames && follow_index(rh, n) != 0) {
+        VS_LOG(mtCritical, "frame %d wasn't written within %d ms", n, rh->follow);
+        stats_free(stats, 3);
+        return NULL;
+    }
+
+    if (rh->region_read)
+        dst[0] = vsapi->newVideoFrame(vi[0].format, vi[0].width, vi[0].height,
+                                      NULL, core);
+    else
+        dst[0] = vsapi->newVideoFrame(rh->out_format, rh->vi[0].width,
+                                      rh->vi[0].height, NULL, core);
+
+    if (rh->rsz) {
+        // container: decompress into a private buffer, frames run in parallel
+        int frame_number = n < rh->vi[0].numFrames ? n : rh->vi[0].numFrames - 1;
+        uint8_t *frame = read_rsz_frame(rh, frame_number, vsapi);
+        if (!frame) {
+            VS_LOG(mtCritical, "read frame failed at frame %d", n);
+            vsapi->freeFrame(dst[0]);
+            stats_free(stats, 3);
+            return NULL;
+        }
+        if (rh->crc)
+            crc = crc32c(0, frame, rh->frame_size);
+        rh->write_frame(rh, frame, dst, write_rows, vsapi, core);
+        free(frame);
+    }
+#ifdef RS_HAVE_SHM
+    else if (rh->shm) {
+        // shared memory: convert straight from the ring slot
+        int frame_number;
+        const uint8_t *frame = read_shm_frame(rh, n, &frame_number, vsapi);
+        if (frame) {
+            if (rh->crc)
+                crc = crc32c(0, frame, rh->frame_size);
+            rh->write_frame(rh, frame, dst, write_rows, vsapi, core);
+        }
+        if (!frame || end_shm_frame(rh, frame_number, vsapi) != 0) {
+            vsapi->freeFrame(dst[0]);
+            vsapi->freeFrame(dst[1]);
+            stats_free(stats, 3);
+            return NULL;
+        }
+    }
+#endif
+#ifdef RS_HAVE_PREADV
+    else if (rh->plane_files) {
+        // one file per plane: all of them are read at the same time
+        int frame_number = n < rh->vi[0].numFrames ? n : rh->vi[0].numFrames - 1;
+        if (read_plane_files(rh, rh->index[frame_number], dst, vsapi, core) != 0) {
+            VS_LOG(mtCritical, "read frame failed at frame %d", n);
+            vsapi->freeFrame(dst[0]);
+            vsapi->freeFrame(dst[1]);
+            stats_free(stats, 3);
+            return NULL;
+        }
+        if (rh->crc)
+            crc = crc_planar_frame(rh, dst, vsapi);
+    }
+    else if (rh->region_read) {
+        // file: only the rows and spans of the region are read
+        int frame_number = n < rh->vi[0].numFrames ? n : rh->vi[0].numFrames - 1;
+        FILE *file = frame_file(rh, frame_number, vsapi);
+        if (!file ||
+            read_region(rh, file, rh->index[frame_number], dst, vsapi, core) != 0) {
+            VS_LOG(mtCritical, "read frame failed at frame %d", n);
+            vsapi->freeFrame(dst[0]);
+            vsapi->freeFrame(dst[1]);
+            stats_free(stats, 3);
+            return NULL;
+        }
+    }
+    else if (rh->direct_read) {
+        // file: planar data goes from disk into the output planes in one call
+        int frame_number = n < rh->vi[0].numFrames ? n : rh->vi[0].numFrames - 1;
+        FILE *file = frame_file(rh, frame_number, vsapi);
+        if (!file ||
+            read_planar_direct(rh, file, rh->index[frame_number], dst, vsapi, core) != 0) {
+            VS_LOG(mtCritical, "read frame failed at frame %d", n);
+            vsapi->freeFrame(dst[0]);
+            vsapi->freeFrame(dst[1]);
+            stats_free(stats, 3);
+            return NULL;
+        }
+        if (rh->crc)
+            crc = crc_planar_frame(rh, dst, vsapi);
+    }
+    else
+#endif
+    if (rh->stripe_rows) {
+        // raw: read and convert the frame a stripe of rows at a time
+        if (read_frame_striped(rh, n, dst, write_rows, rh->crc ? &crc : NULL,
+                               vsapi, core) != 0) {
+            vsapi->freeFrame(dst[0]);
+            vsapi->freeFrame(dst[1]);
+            stats_free(stats, 3);
+            return NULL;
+        }
+    }
+    else
+    {
+        int ret = rh->spool ? read_spooled_frame(rh, n, vsapi)
+                            : read_frame(rh, n, vsapi);
+        if (ret != 0) {
+            vsapi->freeFrame(dst[0]);
+            stats_free(stats, 3);
+            return NULL;
+        }
+        if (rh->crc)
+            crc = crc32c(0, rh->frame_buff, rh->frame_size);
+        rh->write_frame(rh, rh->frame_buff, dst, write_rows, vsapi, core);
+    }
+
+    if (rh->region && !rh->region_read) {
+        // plane files hold raw samples, converted before the region is cut
+        if (rh->plane_files && write_rows)
+            finish_frame(write_rows, dst[0], vsapi);
+        extract_region(rh, dst, rh->stats ? stats : NULL, vsapi, core);
+    }
+    else if (read_planes && write_rows)
+        finish_frame(write_rows, dst[0], vsapi);
+
+    int mismatch = -1;
+    if (rh->crc && n < rh->manifest_frames) {
+        mismatch = crc != rh->manifest[n];
+        if (mismatch)
+            VS_LOG(mtWarning, "CRC32C mismatch at frame %d: %08x, manifest has %08x",
+                   n, crc, rh->manifest[n]);
+    }
+
+    for (int i = 0; i < 2 && dst[i]; i++) {
+        VSMap *props = vsapi->getFramePropsRW(dst[i]);
+        vsapi->propSetInt(props, "_DurationNum", rh->vi[0].fpsDen, paReplace);
+        vsapi->propSetInt(props, "_DurationDen", rh->vi[0].fpsNum, paReplace);
+        vsapi->propSetInt(props, "_SARNum", rh->sar_num, paReplace);
+        vsapi->propSetInt(props, "_SARDen", rh->sar_den, paReplace);
+        if (rh->crc)
+            vsapi->propSetInt(props, "RawCRC32C", crc, paReplace);
+        if (mismatch >= 0)
+            vsapi->propSetInt(props, "RawCRC32CMismatch", mismatch, paReplace);
+        if (i == 0 && rh->stats)
+            stats_set_props(stats, vi[0].format, props, vsapi);
+    }
+    stats_free(stats, 3);
+
+    rs_mutex_lock(&rh->lock);
+    history_add(rh, n, dst, vsapi);
+    rs_mutex_unlock(&rh->lock);
+
+    if (rh->has_alpha)
+        vsapi->freeFrame(dst[1 - index]);
+    return dst[index];
+}
+
+
+static void VS_CC
+set_args_int(int *p, int default_value, const char *arg, vs_args_t *va)
+{
+    int err;
+    *p = (int)va->vsapi->propGetInt(va->in, arg, 0, &err);
+    if (err) {
+        *p = default_value;
+    }
+}
+
+
+static void VS_CC
+set_args_int64(int64_t *p, int default_value, const char *arg, vs_args_t *va)
+{
+    int err;
+    *p = va->vsapi->propGetInt(va->in, arg, 0, &err);
+    if (err) {
+        *p = default_value;
+    }
+}
+
+
+static void VS_CC
+set_args_data(char *p, const char *default_value, const char *arg, size_t n,
+              vs_args_t *va)
+{
+    int err;
+    const char *data = va->vsapi->propGetData(va->in, arg, 0, &err);
+    strncpy(p, err ? default_value : data, n);
+}
+
+
+// out_format: the format of the source with 8~16 bit integer or 32 bit float
+// samples, matched by name. the converters write the source samples into
+// the rows first, so they can't be narrower than those. half floats can
+// only be widened to single
+static const VSFormat *
+find_out_format(const VSFormat *fmt, const char *name, vs_args_t *va)
+{
+    if (fmt->sampleType != stInteger) {
+        const VSFormat *out = fmt->bitsPerSample != 16 ? NULL :
+            va->vsapi->registerFormat(fmt->colorFamily, stFloat, 32,
+                                      fmt->subSamplingW, fmt->subSamplingH, va->core);
+        return out && strcasecmp(out->name, name) == 0 ? out : NULL;
+    }
+
+    for (int bits = fmt->bytesPerSample == 1 ? 8 : 9; bits <= 32; bits++) {
+        int float_out = bits == 32;
+        if (bits > 16 && !float_out)
+            continue;
+        const VSFormat *out =
+            va->vsapi->registerFormat(fmt->colorFamily, float_out ? stFloat : stInteger, bits,
+                                      fmt->subSamplingW, fmt->subSamplingH, va->core);
+        if (out && strcasecmp(out->name, name) == 0)
+            return out;
+    }
+    return NULL;
+}
+
+
+#ifdef RS_HAVE_PREADV
+// plane_files: the segments are the planes of src_fmt in its order, then alpha.
+// frames are counted by the shortest of them
+static const char *open_plane_files(rs_hnd_t *rh, int header)
+{
+    const VSFormat *fmt = rh->vi[0].format;
+    int count = fmt->numPlanes + rh->has_alpha;
+    if (header <= 0 || rh->write_frame != write_planar_frame) {
+        return "plane_files need a planar raw format";
+    }
+    if (rh->num_segments != count) {
+        return "plane_files need one source file per plane";
+    }
+
+    int64_t num_frames = INT_MAX;
+    for (int i = 0; i < count; i++) {
+        int sub = i < fmt->numPlanes && rh->order[i];
+        int width = rh->vi[0].width >> (sub ? fmt->subSamplingW : 0);
+        int height = rh->vi[0].height >> (sub ? fmt->subSamplingH : 0);
+        int row_size = (width * fmt->bytesPerSample + rh->row_adjust) & (~rh->row_adjust);
+        rh->plane_size[i] = (uint64_t)row_size * height;
+
+        int64_t file_size = rh->segment_size ? rh->segment_size[i] : rh->file_size;
+        int64_t frames = (file_size - rh->off_header) /
+                         (int64_t)(rh->off_frame + rh->plane_size[i]);
+        if (frames < num_frames)
+            num_frames = frames;
+
+        if (i == 0) {
+            rh->plane_file[0] = rh->file;
+            continue;
+        }
+        int64_t size;
+        const char *err = open_file(rh->segment_name[i], &rh->plane_file[i], &size);
+        if (err) {
+            return err;
+        }
+    }
+    if (num_frames < 1) {
+        return "too small file size";
+    }
+    rh->vi[0].numFrames = (int)num_frames;
+
+    rh->index = (int64_t *)malloc(sizeof(int64_t) * num_frames);
+    if (!rh->index) {
+        return "failed to create index";
+    }
+    for (int i = 0; i < num_frames; i++)
+        rh->index[i] = i;
+    return NULL;
+}
+#endif
+
+
+// open the source files, a list or numbered pattern as segments of one clip
+static const char * VS_CC open_segments(rs_hnd_t *rh, vs_args_t *va)
+{
+    const VSAPI *vsapi = va->vsapi;
+    int count = vsapi->propNumElements(va->in, "source");
+    const char *first = vsapi->propGetData(va->in, "source", 0, 0);
+    char **names = NULL;
+
+    if (count == 1 && is_pattern(first)) {
+        names = expand_pattern(first, &count);
+        if (count == 0) {
+            free(names);
+            return "source does not exist.";
+        }
+        first = names[0];
+    }
+
+    rh->num_segments = 1;
+    if (count == 1 && strncmp(first, "shm:", 4) == 0) {
+        return open_shm(rh, first + 4);
+    }
+    if (count == 1) {
+        const char *err = open_source_file(rh, first);
+        if (names) {
+            free(names[0]);
+            free(names);
+        }
+        return err;
+    }
+
+    if (!names) {
+        names = (char **)calloc(count, sizeof(char *));
+        if (!names) {
+            return "failed to allocate buffer";
+        }
+        for (int i = 0; i < count; i++) {
+            const char *name = vsapi->propGetData(va->in, "source", i, 0);
+            size_t len = strlen(name) + 1;
+            names[i] = (char *)malloc(len);
+            if (!names[i]) {
+                rh->segment_name = names;
+                rh->num_segments = count;
+                return "failed to allocate buffer";
+            }
+            memcpy(names[i], name, len);
+        }
+    }
+    rh->segment_name = names;
+    rh->num_segments = count;
+
+    rh->segment_size = (int64_t *)malloc(sizeof(int64_t) * count);
+    if (!rh->segment_size) {
+        return "failed to allocate buffer";
+    }
+
+    const char *err = open_source_file(rh, names[0]);
+    if (err) {
+        return err;
+    }
+    rh->segment_size[0] = rh->file_size;
+
+    // only the size is needed now, segments are opened again when read
+    for (int i = 1; i < count; i++) {
+        FILE *file;
+        err = open_file(names[i], &file, &rh->segment_size[i]);
+        if (err) {
+            return err;
+        }
+        fclose(file);
+        if (rh->segment_size[i] < 0) {
+            return "only raw files can be concatenated";
+        }
+    }
+
+    return NULL;
+}
+
+
+// open the source given in the arguments and work out its format, frame
+// count and index. shared by Source and Pack.
+static const char * VS_CC init_handler(rs_hnd_t *rh, vs_args_t *va)
+{
+    const VSAPI *vsapi = va->vsapi;
+
+    const char *err = open_segments(rh, va);
+    if (err) {
+        return err;
+    }
+
+    // a shm ring has its own header, mapped by open_shm
+    int header = rh->shm ? 0 : check_header(rh, vsapi);
+    if (header == -1) {
+        return "invalid YUV4MPEG2 header was found";
+    }
+    if (header == -2) {
+        return "unsupported YUV4MPEG2 header was found";
+    }
+    if (header == -3) {
+        return "invalid compressed container was found";
+    }
+    if (header == -4) {
+        return "unsupported DPX header was found";
+    }
+
+    if (header > 0) {
+        set_args_int(&rh->vi[0].width, 720, "width", va);
+        set_args_int(&rh->vi[0].height, 480, "height", va);
+        set_args_int(&rh->off_header, 0, "off_header", va);
+        set_args_int(&rh->off_frame, 0, "off_frame", va);
+        set_args_int(&rh->sar_num, 1, "sarnum", va);
+        set_args_int(&rh->sar_den, 1, "sarden", va);
+        set_args_int(&rh->row_adjust, 1, "rowbytes_align", va);
+        set_args_data(rh->src_format, "I420", "src_fmt", FORMAT_MAX_LEN, va);
+    }
+
+    set_args_int(&rh->hugepages, 0, "hugepages", va);
+    set_args_int(&rh->stream, 0, "stream", va);
+
+    if (rh->vi[0].fpsNum == 0 && rh->vi[0].fpsDen == 0) {
+        set_args_int64(&rh->vi[0].fpsNum, 30000, "fpsnum", va);
+        set_args_int64(&rh->vi[0].fpsDen, 1001, "fpsden", va);
+    }
+
+    rh->row_adjust--;
+    if (rh->row_adjust < 0 || rh->row_adjust > 15) {
+        VS_LOG(mtWarning, "invalid rowbytes_align requested, setting to 0");
+        rh->row_adjust = 0;
+    }
+
+    uint64_t packed_frame_size = rh->frame_size;
+
+    const char *ca = check_args(rh, va);
+    if (ca) {
+        return ca;
+    }
+
+    if (rh->num_segments > 1 && (rh->rsz || rh->file_size < 0)) {
+        return "only raw files can be concatenated";
+    }
+
+    set_args_int(&rh->plane_files, 0, "plane_files", va);
+#ifndef RS_HAVE_PREADV
+    if (rh->plane_files) {
+        return "plane_files aren't supported on this platform";
+    }
+#endif
+
+    // follow: only a single file, read from its header onwards, can grow
+    set_args_int(&rh->follow, 0, "follow", va);
+    if (rh->follow < 0) {
+        return "invalid follow requested";
+    }
+    if (rh->follow && (rh->num_segments > 1 || rh->rsz || rh->shm || rh->file_size < 0 ||
+                       rh->plane_files)) {
+        return "follow needs a single raw file";
+    }
+
+    if (rh->rsz)
+    {
+        // container: frame count and index come from its seek table
+        if (rh->frame_size != packed_frame_size) {
+            return "compressed container doesn't match its format";
+        }
+    }
+    else if (rh->shm)
+    {
+        // shm: as endless as a pipe, frames stay in the ring for a while
+        if (rh->shm->slot_size < rh->frame_size) {
+            return "shared memory ring slots are smaller than a frame";
+        }
+        rh->vi[0].numFrames = 30*60*60*6;
+        rh->index = NULL;
+    }
+    else if (rh->file_size < 0)
+    {
+        // pipe: make the source "infinite"
+        // note: INT32_MAX doesn't work with some plugins (MVTools), use large number
+        rh->vi[0].numFrames = 30*60*60*6;
+        rh->index = NULL;
+#ifdef RS_HAVE_PIPE_FD
+        open_pipe_direct(rh, vsapi);
+#endif
+
+        int read_ahead;
+        set_args_int(&read_ahead, 0, "read_ahead", va);
+        if (read_ahead < 0) {
+            return "invalid read_ahead requested";
+        }
+        if (read_ahead > 0) {
+#ifdef RS_HAVE_PIPE_FD
+            err = open_pipe_reader(rh, read_ahead);
+            if (err) {
+                return err;
+            }
+#else
+            return "read_ahead isn't supported on this platform";
+#endif
+        }
+
+        int spool;
+        set_args_int(&spool, 0, "spool", va);
+        set_args_int(&rh->spool_frames, 0, "spool_frames", va);
+        if (rh->spool_frames < 0) {
+            return "invalid spool_frames requested";
+        }
+        if (spool) {
+            rh->spool = open_spool_file();
+            if (!rh->spool) {
+                return "failed to create spool file";
+            }
+        }
+    }
+#ifdef RS_HAVE_PREADV
+    else if (rh->plane_files)
+    {
+        // one file per plane: index holds the position of every frame in them
+        err = open_plane_files(rh, header);
+        if (err) {
+            return err;
+        }
+    }
+#endif
+    else
+    {
+        int64_t num_frames = segment_frames(rh, rh->file_size);
+        for (int i = 1; i < rh->num_segments; i++)
+            num_frames += segment_frames(rh, rh->segment_size[i]);
+        if (num_frames > INT_MAX) {
+            return "too many frames";
+        }
+        rh->vi[0].numFrames = (int)num_frames;
+
+        if (rh->vi[0].numFrames < 1 && !rh->follow) {
+            return "too small file size";
+        }
+        if (create_index(rh)) {
+            return "failed to create index";
+        }
+
+        if (rh->follow) {
+            // the file is still being written: make the source as "infinite"
+            // as a pipe, and extend the index when frames past its end arrive
+            rh->index_frames = rh->index_capacity = rh->vi[0].numFrames;
+            rh->vi[0].numFrames = 30*60*60*6;
+        }
+    }
+
+    set_args_int(&rh->crc, 0, "crc", va);
+    int err_manifest;
+    const char *manifest = vsapi->propGetData(va->in, "manifest", 0, &err_manifest);
+    if (!err_manifest) {
+        rh->crc = 1;
+        err = load_manifest(rh, manifest);
+        if (err) {
+            return err;
+        }
+    }
+
+    set_args_int(&rh->stats, 0, "stats", va);
+    if (rh->stats < 0 || rh->stats > 2) {
+        return "invalid stats requested";
+    }
+
+    int start, end, step;
+    set_args_int(&start, 0, "start", va);
+    set_args_int(&end, rh->vi[0].numFrames, "end", va);
+    set_args_int(&step, 1, "step", va);
+    if (start != 0 || end != rh->vi[0].numFrames || step != 1) {
+        if (!rh->index || rh->follow) {
+            return "start, end and step need a seekable source";
+        }
+        if (start < 0 || end > rh->vi[0].numFrames || start >= end || step < 1) {
+            return "invalid frame range requested";
+        }
+        decimate_index(rh, start, end, step);
+    }
+
+    if (rh->has_alpha) {
+        rh->vi[1] = rh->vi[0];
+        int bytes = rh->vi[0].format->bytesPerSample;
+        VSPresetFormat pf = rh->vi[0].format->sampleType == stFloat ?
+                            (bytes == 2 ? pfGrayH : pfGrayS) :
+                            (bytes == 1 ? pfGray8 : pfGray16);
+        rh->vi[1].format = vsapi->getFormatPreset(pf, va->core);
+    }
+
+    set_args_int(&rh->crop_left, 0, "crop_left", va);
+    set_args_int(&rh->crop_top, 0, "crop_top", va);
+    set_args_int(&rh->crop_width, rh->vi[0].width - rh->crop_left, "crop_width", va);
+    set_args_int(&rh->crop_height, rh->vi[0].height - rh->crop_top, "crop_height", va);
+    if (rh->crop_left < 0 || rh->crop_top < 0 || rh->crop_width < 1 || rh->crop_height < 1 ||
+        rh->crop_left + rh->crop_width > rh->vi[0].width ||
+        rh->crop_top + rh->crop_height > rh->vi[0].height) {
+        return "invalid crop region";
+    }
+    const VSFormat *fmt = rh->vi[0].format;
+    if (((rh->crop_left | rh->crop_width) & ((1 << fmt->subSamplingW) - 1)) ||
+        ((rh->crop_top | rh->crop_height) & ((1 << fmt->subSamplingH) - 1))) {
+        return "crop region doesn't fit the chroma subsampling";
+    }
+
+    rh->out_format = fmt;
+    char out_format[FORMAT_MAX_LEN];
+    set_args_data(out_format, "", "out_format", FORMAT_MAX_LEN, va);
+    if (out_format[0]) {
+        rh->out_format = find_out_format(fmt, out_format, va);
+        if (!rh->out_format) {
+            return "out_format has to be the source format at another depth, or as float";
+        }
+    }
+
+    rh->plane = -1;
+    int num_planes = vsapi->propNumElements(va->in, "planes");
+    if (num_planes > 0 && num_planes < fmt->numPlanes) {
+        if (num_planes > 1) {
+            return "planes must select a single plane or all of them";
+        }
+        rh->plane = (int)vsapi->propGetInt(va->in, "planes", 0, NULL);
+        if (rh->plane < 0 || rh->plane >= fmt->numPlanes) {
+            return "invalid plane requested";
+        }
+        rh->plane_format = vsapi->registerFormat(cmGray, rh->out_format->sampleType,
+                                                 rh->out_format->bitsPerSample, 0, 0,
+                                                 va->core);
+    }
+
+    rh->region = rh->crop_width != rh->vi[0].width || rh->crop_height != rh->vi[0].height ||
+                 rh->plane >= 0;
+
+    return NULL;
+}
+
+
+static rs_hnd_t *create_handler(void)
+{
+    rs_hnd_t *rh = (rs_hnd_t *)calloc(sizeof(rs_hnd_t), 1);
+    if (rh) {
+        rs_mutex_init(&rh->lock);
+        rh->last_frame_number = -1;
+    }
+    return rh;
+}
+
+
+#define RET_IF_ERROR(cond, ...) \
+{\
+    if (cond) {\
+        close_handler(rh);\
+        snprintf(msg, 240, __VA_ARGS__);\
+        vsapi->setError(out, msg_buff);\
+        return;\
+    }\
+}
+
+static void VS_CC
+create_source(const VSMap *in, VSMap *out, void *user_data, VSCore *core,
+              const VSAPI *vsapi)
+{
+    char msg_buff[256] = "raws: ";
+    char *msg = msg_buff + strlen(msg_buff);
+
+    rs_hnd_t *rh = create_handler();
+    RET_IF_ERROR(!rh, "couldn't create handler");
 
-    return NULL;
-}
+    vs_args_t va = { in, out, core, vsapi };
 
+    const char *err = init_handler(rh, &va);
+    RET_IF_ERROR(err, "%s", err);
 
-static void close_handler(rs_hnd_t *rh)
-{
-    if (!rh) {
-        return;
+#ifdef RS_HAVE_PREADV
+    // seekable planar and semi-planar sources read only the region, unless
+    // the whole frame is needed for its crc
+    if (rh->region && !rh->crc && rh->index && !rh->rsz && !rh->plane_files &&
+        (rh->write_frame == write_planar_frame || rh->write_frame == write_nvxx_frame ||
+         rh->write_frame == write_px1x_frame)) {
+        rh->span_iov_max = planar_iov_count(rh) * 2;
+        rh->iov = (struct iovec *)malloc(sizeof(struct iovec) * rh->span_iov_max);
+        rh->span_scratch = (uint8_t *)malloc(SPAN_GAP_MAX);
+        RET_IF_ERROR(!rh->iov || !rh->span_scratch, "failed to allocate buffer");
+        rh->region_read = 1;
     }
-    if (rh->frame_buff) {
-        free(rh->frame_buff);
+
+    // seekable planar sources skip frame_buff and read into the frame planes,
+    // as do plane files
+    if (rh->plane_files ||
+        (!rh->region && rh->index && !rh->rsz && rh->write_frame == write_planar_frame)) {
+        rh->iov = (struct iovec *)malloc(sizeof(struct iovec) * planar_iov_count(rh));
+        RET_IF_ERROR(!rh->iov, "failed to allocate buffer");
+        rh->direct_read = !rh->plane_files;
     }
-    if (rh->index) {
-        free(rh->index);
+#endif
+
+    // streamed frames only need a buffer for a stripe of rows
+    if (rh->stream && !rh->direct_read && !rh->region_read && !rh->rsz && !rh->shm &&
+        !rh->plane_files && !rh->spool) {
+        int stride = stripe_stride(rh);
+        if (stride) {
+            rh->stripe_rows = STRIPE_SIZE / stride > 0 ? STRIPE_SIZE / stride : 1;
+            if (rh->stripe_rows > rh->vi[0].height)
+                rh->stripe_rows = rh->vi[0].height;
+        } else {
+            VS_LOG(mtWarning, "%s frames can't be streamed, reading whole frames",
+                   rh->src_format);
+        }
     }
-    if (rh->file) {
-        fclose(rh->file);
+
+    // containers decompress into per-request buffers instead, shm rings are
+    // read in place, planar crop reads don't need one either
+    if (!rh->direct_read && !rh->rsz && !rh->shm && !rh->plane_files &&
+        !(rh->region_read && rh->write_frame == write_planar_frame)) {
+        rh->frame_buff_size = rh->stripe_rows ? (size_t)rh->stripe_rows * stripe_stride(rh)
+                                              : rh->frame_size;
+        rh->frame_buff = alloc_buffer(rh->frame_buff_size + 32, rh->hugepages,
+                                      &rh->frame_buff_mapped);
+        RET_IF_ERROR(!rh->frame_buff, "failed to allocate buffer");
     }
-    free(rh);
-}
 
+    // nfNoCache because the system file cache is used
+    // nfMakeLinear because disk drives are faster in sequential access
+    int flags = nfNoCache | nfMakeLinear;
 
-static void VS_CC
-vs_close(void *instance_data, VSCore *core, const VSAPI *vsapi)
-{
-    rs_hnd_t *rh = (rs_hnd_t *)instance_data;
-    close_handler(rh);
+    // fmUnordered since get_frame isn't reentrant; even for the non-pipe case,
+    // the same rh->frame_buff will be used to service parallel requests.
+    // containers have no shared frame buffer and decompress in parallel.
+    vsapi->createFilter(in, out, "Source", vs_init, rs_get_frame, vs_close,
+                        rh->rsz ? fmParallel : fmUnordered, flags, rh, core);
 }
 
 
-static void VS_CC
-vs_init(VSMap *in, VSMap *out, void **instance_data, VSNode *node,
-        VSCore *core, const VSAPI *vsapi)
-{
-    rs_hnd_t *rh = (rs_hnd_t *)*instance_data;
-    vsapi->setVideoInfo(rh->vi, rh->has_alpha + 1, node);
-}
-
-static void
-history_free(rs_history_t* node, const VSAPI *vsapi)
+static const char * VS_CC
+pack_source(rs_hnd_t *rh, FILE *file, uint32_t codec, int level, int *num_frames,
+            const VSAPI *vsapi)
 {
-    if (node->next)
-        history_free(node->next, vsapi);
+    rsz_header_t hdr = { { 0 } };
+    memcpy(hdr.signature, RSZ_SIGNATURE, sizeof(hdr.signature));
+    hdr.header_size = sizeof(hdr);
+    hdr.codec = codec;
+    hdr.width = rh->vi[0].width;
+    hdr.height = rh->vi[0].height;
+    hdr.fps_num = rh->vi[0].fpsNum;
+    hdr.fps_den = rh->vi[0].fpsDen;
+    hdr.sar_num = rh->sar_num;
+    hdr.sar_den = rh->sar_den;
+    hdr.rowbytes_align = rh->row_adjust + 1;
+    hdr.frame_size = rh->frame_size;
+    hdr.flags = rh->flip_v ? RSZ_FLAG_FLIP_V : 0;
+    strncpy(hdr.src_fmt, rh->src_format, sizeof(hdr.src_fmt) - 1);
+
+    // header is rewritten with the frame count and table offset at the end
+    rsz_header_t le = hdr;
+    rsz_swap_header(&le);
+    if (fwrite(&le, sizeof(le), 1, file) != 1) {
+        return "failed to write output";
+    }
 
-    vsapi->freeFrame(node->frame);
-    free(node);
-}
+    int capacity = rh->index ? rh->vi[0].numFrames + 1 : 1024;
+    int64_t *table = (int64_t *)malloc(sizeof(int64_t) * capacity);
+    uint8_t *block = (uint8_t *)malloc(rh->frame_size);
+    if (!table || !block) {
+        free(table);
+        free(block);
+        return "failed to allocate buffer";
+    }
 
-static void
-history_add(rs_hnd_t* rh, int frameNumber, const VSFrameRef* frame, int index, const VSAPI *vsapi, VSCore* core)
-{
-    // note: before this is called we already determined frame
-    // was *not* in the history, no check for that here
+    const char *err = NULL;
+    int64_t pos = sizeof(hdr);
+    int n;
+    for (n = 0; n < rh->vi[0].numFrames; n++) {
+        if (!rh->index) {
+            // pipe: stop quietly at the end of the stream
+            if (pipe_eof(rh))
+                break;
+        }
 
-    rs_history_t* h = (rs_history_t*)calloc(1, sizeof(*rh->history));
-    h->frameNumber = frameNumber;
-    h->frame = vsapi->copyFrame(frame, core);
+        if (read_frame(rh, n, vsapi) != 0) {
+            err = "failed to read source";
+            break;
+        }
 
-    if (rh->history[index])
-    {
-        rs_history_t* node = rh->history[index];
-        int length = 1;
-        while (node->next)
-        {
-            length++;
-            node = node->next;
+        size_t size = compress_block(codec, level, rh->frame_buff, rh->frame_size,
+                                     block, rh->frame_size - 1);
+        const uint8_t *data = size ? block : rh->frame_buff;
+        if (size == 0)
+            size = rh->frame_size;
+
+        if (n + 1 >= capacity) {
+            capacity *= 2;
+            int64_t *tmp = (int64_t *)realloc(table, sizeof(int64_t) * capacity);
+            if (!tmp) {
+                err = "failed to allocate buffer";
+                break;
+            }
+            table = tmp;
         }
-        node->next = h;
 
-        if (length > 16)
-        {
-            rs_history_t* del = rh->history[index];
-            rh->history[index] = del->next;
-            del->next = NULL;
-            history_free(del, vsapi);
+        if (fwrite(data, 1, size, file) != size) {
+            err = "failed to write output";
+            break;
         }
+        table[n] = pos;
+        pos += size;
     }
-    else
-    {
-        rh->history[index] = h;
-    }
-}
 
-static VSFrameRef* history_get(const rs_hnd_t* rh, int frameNumber, int index)
-{
-    VSFrameRef* frame = NULL;
+    if (!err && n == 0) {
+        err = "no frames to pack";
+    }
 
-    rs_history_t* node = rh->history[index];
-    while (node)
-    {
-        if (node->frameNumber == frameNumber)
-        {
-            frame = node->frame;
-            break;
+    if (!err) {
+        table[n] = pos;
+        hdr.num_frames = n;
+        hdr.seek_table = pos;
+        le = hdr;
+        rsz_swap_header(&le);
+        rsz_swap_table(table, n + 1);
+        if (fwrite(table, sizeof(int64_t), n + 1, file) != (size_t)n + 1 ||
+            rs_fseek(file, 0, SEEK_SET) != 0 ||
+            fwrite(&le, sizeof(le), 1, file) != 1) {
+            err = "failed to write output";
         }
-        node = node->next;
     }
 
-    return frame;
+    free(table);
+    free(block);
+    *num_frames = n;
+    return err;
 }
 
-static const VSFrameRef * VS_CC
-rs_get_frame(int n, int activation_reason, void **instance_data,
-             void **frame_data, VSFrameContext *frame_ctx, VSCore *core,
-             const VSAPI *vsapi)
+
+static void VS_CC
+create_pack(const VSMap *in, VSMap *out, void *user_data, VSCore *core,
+            const VSAPI *vsapi)
 {
-    if (activation_reason != arInitial)
-        return NULL;
+    char msg_buff[256] = "raws: ";
+    char *msg = msg_buff + strlen(msg_buff);
 
-    rs_hnd_t *rh = (rs_hnd_t *)*instance_data;
+    rs_hnd_t *rh = create_handler();
+    RET_IF_ERROR(!rh, "couldn't create handler");
 
-    VSFrameRef *dst[2] = {NULL};
+    vs_args_t va = { in, out, core, vsapi };
 
-    // try to get frame from history
-    for (int i = 0; i < 2; i++)
-    {
-        VSFrameRef* ref = history_get(rh, n, i);
-        if (ref)
-            dst[i] = vsapi->copyFrame(ref, core);
-    }
+    const char *err = init_handler(rh, &va);
+    RET_IF_ERROR(err, "%s", err);
+    RET_IF_ERROR(rh->rsz, "source is already a compressed container");
+    RET_IF_ERROR(rh->shm, "shm: sources can't be packed");
+    RET_IF_ERROR(rh->plane_files, "plane files can't be packed");
+    RET_IF_ERROR(rh->frame_size > UINT32_MAX, "frames over 4GB can't be packed");
 
-    if (!dst[0])
-    {
-        // pipe: detect out-of-order frame requests, which are possible
-        // if vspipe --requests > 1
-        static int next_frame_number = 0;
-        if (!rh->index && n != next_frame_number)
-            VS_LOG(mtCritical, "seeking a pipe is unsupported: need frame %d, requested %d",
-                next_frame_number, n);
-        next_frame_number = n+1;
+    const struct {
+        const char *name;
+        uint32_t codec;
+    } codecs[] = {
+#ifdef HAVE_LZ4
+        { "lz4",  RSZ_CODEC_LZ4  },
+#endif
+#ifdef HAVE_ZSTD
+        { "zstd", RSZ_CODEC_ZSTD },
+#endif
+        { "none", RSZ_CODEC_NONE },
+    };
 
+    char codec_name[FORMAT_MAX_LEN] = { 0 };
+    set_args_data(codec_name, codecs[0].name, "codec", FORMAT_MAX_LEN - 1, &va);
 
-        uint8_t* read_ptr = rh->frame_buff;
-        size_t read_len      = rh->frame_size;
+    int c = 0;
+    int num_codecs = sizeof(codecs) / sizeof(codecs[0]);
+    while (c < num_codecs && strcasecmp(codec_name, codecs[c].name) != 0)
+        c++;
+    RET_IF_ERROR(c == num_codecs, "codec '%s' is not supported by this build", codec_name);
 
-        if (rh->index) {
-            // file: seek to just after the frame header
-            int frame_number = n;
-            if (n >= rh->vi[0].numFrames)
-                frame_number = rh->vi[0].numFrames - 1;
+    int level;
+    set_args_int(&level, 3, "level", &va);
 
-            if (rs_fseek(rh->file, rh->index[frame_number], SEEK_SET) != 0)
-                return NULL;
-        }
-        else if (rh->off_frame > 0 && !(n==0 && rh->skip_first_frame_header)) {
-            // pipe: read off frame header
-            // todo: non-sequential access check
-            if (rh->off_frame != fread(rh->frame_buff, 1, rh->off_frame, rh->file))
-            {
-                VS_LOG(mtCritical, "read frame header failed at frame %d", n);
-                return NULL;
-            }
-        }
-        else if (rh->off_frame == 0 && n == 0 && rh->write_magic)
-        {
-            // pipe: first frame needs to include magic bytes
-            int len = sizeof(rh->magic);
-            memcpy(read_ptr, rh->magic, len);
-            read_ptr += len;
-            read_len -= len;
-        }
+    rh->frame_buff_size = rh->frame_size;
+    rh->frame_buff = alloc_buffer(rh->frame_size + 32, rh->hugepages,
+                                  &rh->frame_buff_mapped);
+    RET_IF_ERROR(!rh->frame_buff, "failed to allocate buffer");
 
-        if (fread(read_ptr, 1, read_len, rh->file) < read_len)
-        {
-             VS_LOG(mtCritical, "read frame failed at frame %d", n);
-             return NULL;
-        }
+    const char *output = vsapi->propGetData(in, "output", 0, 0);
+#ifdef _WIN32
+    wchar_t tmp[FILENAME_MAX * 4];
+    MultiByteToWideChar(CP_UTF8, 0, output, -1, tmp, FILENAME_MAX * 4);
+    FILE *file = _wfopen(tmp, L"wb");
+#else
+    FILE *file = fopen(output, "wb");
+#endif
+    RET_IF_ERROR(!file, "failed to open output file");
 
-        dst[0] = vsapi->newVideoFrame(rh->vi[0].format, rh->vi[0].width, rh->vi[0].height,
-                                      NULL, core);
+    int num_frames = 0;
+    err = pack_source(rh, file, codecs[c].codec, level, &num_frames, vsapi);
+    fclose(file);
+    RET_IF_ERROR(err, "%s", err);
 
-        VSMap *props = vsapi->getFramePropsRW(dst[0]);
-        vsapi->propSetInt(props, "_DurationNum", rh->vi[0].fpsDen, paReplace);
-        vsapi->propSetInt(props, "_DurationDen", rh->vi[0].fpsNum, paReplace);
-        vsapi->propSetInt(props, "_SARNum", rh->sar_num, paReplace);
-        vsapi->propSetInt(props, "_SARDen", rh->sar_den, paReplace);
+    VS_LOG(mtDebug, "create_pack: packed %d frames with %s", num_frames, codecs[c].name);
 
-        rh->write_frame(rh, dst, vsapi, core);
+    vsapi->propSetInt(out, "frames", num_frames, paReplace);
+    close_handler(rh);
+}
+#define WRITE_ALIGN 4096
 
-        history_add(rh, n, dst[0], 0, vsapi, core);
-    }
+typedef struct {
+    const VSFrameRef *frame[2];  // base and alpha
+    rs_sem_t ready;              // posted once per requested clip
+    int failed;
+} rs_fetch_slot_t;
 
-    if (rh->has_alpha == 0) {
-        return dst[0];
-    }
+typedef struct {
+    VSNodeRef *node[2];
+    int num_nodes;
+    int num_slots;
+    rs_fetch_slot_t *slots;
+
+    // double buffered output, packing of the next frame overlaps the write
+    int fd;
+    uint8_t *buff[2];
+    size_t buff_mapped[2];
+    size_t len[2];
+    rs_sem_t free;
+    rs_sem_t full;
+    int quit;
+    int error;
+} rs_writer_t;
 
-    if (vsapi->getOutputIndex(frame_ctx) == 0) {
-        vsapi->freeFrame(dst[1]);
-        return dst[0];
-    }
 
-    vsapi->freeFrame(dst[0]);
-    VSMap* props = vsapi->getFramePropsRW(dst[1]);
-    vsapi->propSetInt(props, "_DurationNum", rh->vi[1].fpsDen, paReplace);
-    vsapi->propSetInt(props, "_DurationDen", rh->vi[1].fpsNum, paReplace);
-    vsapi->propSetInt(props, "_SARNum", rh->sar_num, paReplace);
-    vsapi->propSetInt(props, "_SARDen", rh->sar_den, paReplace);
+static void VS_CC
+fetch_done(void *user_data, const VSFrameRef *f, int n, VSNodeRef *node,
+           const char *error_msg)
+{
+    rs_writer_t *w = (rs_writer_t *)user_data;
+    rs_fetch_slot_t *slot = &w->slots[n % w->num_slots];
+
+    slot->frame[node == w->node[0] ? 0 : 1] = f;
+    if (!f)
+        slot->failed = 1;
+    rs_sem_post(&slot->ready);
+}
 
-    history_add(rh, n, dst[1], 1, vsapi, core);
 
-    return dst[1];
+static void fetch_frame(rs_writer_t *w, int n, const VSAPI *vsapi)
+{
+    rs_fetch_slot_t *slot = &w->slots[n % w->num_slots];
+    slot->frame[0] = slot->frame[1] = NULL;
+    slot->failed = 0;
+    for (int i = 0; i < w->num_nodes; i++)
+        vsapi->getFrameAsync(n, w->node[i], fetch_done, w);
 }
 
 
-static void VS_CC
-set_args_int(int *p, int default_value, const char *arg, vs_args_t *va)
+static int write_all(int fd, const uint8_t *buff, size_t len)
 {
-    int err;
-    *p = (int)va->vsapi->propGetInt(va->in, arg, 0, &err);
-    if (err) {
-        *p = default_value;
+    while (len > 0) {
+#ifdef _WIN32
+        int ret = _write(fd, buff, len > INT_MAX ? INT_MAX : (unsigned)len);
+#else
+        ssize_t ret = write(fd, buff, len);
+#endif
+        if (ret <= 0)
+            return -1;
+        buff += ret;
+        len -= ret;
     }
+    return 0;
 }
 
 
-static void VS_CC
-set_args_int64(int64_t *p, int default_value, const char *arg, vs_args_t *va)
+static RS_THREAD_FUNC(write_thread, arg)
 {
-    int err;
-    *p = va->vsapi->propGetInt(va->in, arg, 0, &err);
-    if (err) {
-        *p = default_value;
+    rs_writer_t *w = (rs_writer_t *)arg;
+
+    for (int i = 0; ; i ^= 1) {
+        rs_sem_wait(&w->full);
+        if (w->quit)
+            break;
+        if (!w->error && write_all(w->fd, w->buff[i], w->len[i]) != 0)
+            w->error = 1;
+        rs_sem_post(&w->free);
     }
+
+    RS_THREAD_RETURN;
 }
 
 
-static void VS_CC
-set_args_data(char *p, const char *default_value, const char *arg, size_t n,
-              vs_args_t *va)
+// find the y4m colorspace tag for the clip format, sets up rh for it
+static const char *find_y4m_format(rs_hnd_t *rh, const VSFormat *format, vs_args_t *va)
 {
-    int err;
-    const char *data = va->vsapi->propGetData(va->in, arg, 0, &err);
-    strncpy(p, err ? default_value : data, n);
+    for (int i = 0; i < NUM_Y4M_FORMATS; i++) {
+        strcpy(rh->src_format, y4m_formats[i].format);
+        if (!check_args(rh, va) && rh->vi[0].format->id == format->id)
+            return y4m_formats[i].tag;
+    }
+    return NULL;
 }
 
 
-#define RET_IF_ERROR(cond, ...) \
-{\
-    if (cond) {\
-        close_handler(rh);\
-        snprintf(msg, 240, __VA_ARGS__);\
-        vsapi->setError(out, msg_buff);\
-        return;\
-    }\
+// a row of fully opaque alpha, for a clip written without an alpha clip
+static void *alloc_opaque_row(const rs_hnd_t *rh)
+{
+    const VSFormat *fmt = rh->vi[0].format;
+    int width = rh->vi[0].width;
+    uint8_t *row = (uint8_t *)malloc((size_t)width * fmt->bytesPerSample);
+    if (!row)
+        return NULL;
+
+    if (fmt->bytesPerSample == 1) {
+        memset(row, 0xFF, width);
+    } else if (fmt->bytesPerSample == 2) {
+        // 1.0 for half floats
+        uint16_t one = fmt->sampleType == stFloat ? 0x3C00 : 0xFFFF;
+        for (int x = 0; x < width; x++)
+            ((uint16_t *)row)[x] = one;
+    } else {
+        for (int x = 0; x < width; x++)
+            ((float *)row)[x] = 1.0f;
+    }
+    return row;
+}
+
+
+// pull the frames of the clip(s), pack them and hand them to the writer thread
+static const char * VS_CC
+write_clip(rs_hnd_t *rh, rs_writer_t *w, const char *y4m_tag, int *num_frames,
+           const VSAPI *vsapi)
+{
+    int total = vsapi->getVideoInfo(w->node[0])->numFrames;
+    int issued = 0;
+    int cur = 0;            // buffer being filled
+    size_t carry = 0;       // unaligned tail of the previous buffer, moved into the next
+    const char *err = NULL;
+    int n;
+
+    for (; issued < total && issued < w->num_slots; issued++)
+        fetch_frame(w, issued, vsapi);
+
+    for (n = 0; n < total; n++) {
+        rs_fetch_slot_t *slot = &w->slots[n % w->num_slots];
+        for (int i = 0; i < w->num_nodes; i++)
+            rs_sem_wait(&slot->ready);
+
+        if (slot->failed || w->error) {
+            err = slot->failed ? "failed to get frame from clip" : "failed to write output";
+            break;
+        }
+
+        rs_sem_wait(&w->free);
+
+        uint8_t *dst = w->buff[cur];
+        if (carry)
+            memcpy(dst, w->buff[cur ^ 1] + w->len[cur ^ 1], carry);
+        dst += carry;
+
+        if (y4m_tag) {
+            if (n == 0) {
+                int err_sar;
+                const VSMap *props = vsapi->getFramePropsRO(slot->frame[0]);
+                int sar_num = (int)vsapi->propGetInt(props, "_SARNum", 0, &err_sar);
+                int sar_den = err_sar ? 0 : (int)vsapi->propGetInt(props, "_SARDen", 0, &err_sar);
+                dst += sprintf((char *)dst, "YUV4MPEG2 W%d H%d F%" PRId64 ":%" PRId64 " Ip A%d:%d C%s\n",
+                               rh->vi[0].width, rh->vi[0].height, rh->vi[0].fpsNum, rh->vi[0].fpsDen,
+                               err_sar ? 0 : sar_num, err_sar ? 0 : sar_den, y4m_tag);
+            }
+            memcpy(dst, "FRAME\n", 6);
+            dst += 6;
+        }
+
+        rh->pack_frame(rh, slot->frame, dst, vsapi);
+        dst += rh->frame_size;
+
+        for (int i = 0; i < w->num_nodes; i++)
+            vsapi->freeFrame(slot->frame[i]);
+        if (issued < total)
+            fetch_frame(w, issued++, vsapi);
+
+        // only whole blocks are written so that O_DIRECT works
+        size_t len = dst - w->buff[cur];
+        w->len[cur] = len & ~((size_t)WRITE_ALIGN - 1);
+        carry = len - w->len[cur];
+
+        rs_sem_post(&w->full);
+        cur ^= 1;
+    }
+
+    // wait for requests still in flight after an error
+    for (int m = n + 1; m < issued; m++) {
+        rs_fetch_slot_t *slot = &w->slots[m % w->num_slots];
+        for (int i = 0; i < w->num_nodes; i++)
+            rs_sem_wait(&slot->ready);
+        for (int i = 0; i < w->num_nodes; i++)
+            vsapi->freeFrame(slot->frame[i]);
+    }
+    if (n < total) {
+        rs_fetch_slot_t *slot = &w->slots[n % w->num_slots];
+        for (int i = 0; i < w->num_nodes; i++)
+            vsapi->freeFrame(slot->frame[i]);
+    }
+
+    // drain the writer, then write the unaligned tail without O_DIRECT
+    rs_sem_wait(&w->free);
+    rs_sem_wait(&w->free);
+    if (!err && carry) {
+#if defined(O_DIRECT) && !defined(_WIN32)
+        fcntl(w->fd, F_SETFL, fcntl(w->fd, F_GETFL) & ~O_DIRECT);
+#endif
+        uint8_t *last = w->buff[cur ^ 1];
+        if (write_all(w->fd, last + w->len[cur ^ 1], carry) != 0)
+            w->error = 1;
+    }
+    if (!err && w->error)
+        err = "failed to write output";
+
+    *num_frames = n;
+    return err;
 }
 
+
 static void VS_CC
-create_source(const VSMap *in, VSMap *out, void *user_data, VSCore *core,
-              const VSAPI *vsapi)
+create_write(const VSMap *in, VSMap *out, void *user_data, VSCore *core,
+             const VSAPI *vsapi)
 {
     char msg_buff[256] = "raws: ";
     char *msg = msg_buff + strlen(msg_buff);
 
-    rs_hnd_t *rh = (rs_hnd_t *)calloc(sizeof(rs_hnd_t), 1);
+    rs_hnd_t *rh = create_handler();
     RET_IF_ERROR(!rh, "couldn't create handler");
 
-    const char *err =
-        open_source_file(rh, vsapi->propGetData(in, "source", 0, 0));
-    RET_IF_ERROR(err, "%s", err);
-
-    int header = check_header(rh, vsapi);
-    RET_IF_ERROR(header == -1, "invalid YUV4MPEG2 header was found");
-    RET_IF_ERROR(header == -2, "unsupported YUV4MPEG2 header was found");
-
     vs_args_t va = { in, out, core, vsapi };
 
-    if (header > 0) {
-        set_args_int(&rh->vi[0].width, 720, "width", &va);
-        set_args_int(&rh->vi[0].height, 480, "height", &va);
-        set_args_int(&rh->off_header, 0, "off_header", &va);
-        set_args_int(&rh->off_frame, 0, "off_frame", &va);
-        set_args_int(&rh->sar_num, 1, "sarnum", &va);
-        set_args_int(&rh->sar_den, 1, "sarden", &va);
-        set_args_int(&rh->row_adjust, 1, "rowbytes_align", &va);
-        set_args_data(rh->src_format, "I420", "src_fmt", FORMAT_MAX_LEN, &va);
-    }
+    VSNodeRef *node = vsapi->propGetNode(in, "clip", 0, 0);
+    const VSVideoInfo *vi = vsapi->getVideoInfo(node);
+    int err;
+    VSNodeRef *alpha = vsapi->propGetNode(in, "alpha", 0, &err);
 
-    if (rh->vi[0].fpsNum == 0 && rh->vi[0].fpsDen == 0) {
-        set_args_int64(&rh->vi[0].fpsNum, 30000, "fpsnum", &va);
-        set_args_int64(&rh->vi[0].fpsDen, 1001, "fpsden", &va);
+#define RET_IF_WRITE_ERROR(cond, ...) \
+    if (cond) {\
+        vsapi->freeNode(node);\
+        vsapi->freeNode(alpha);\
+        RET_IF_ERROR(1, __VA_ARGS__);\
     }
 
-    rh->row_adjust--;
-    if (rh->row_adjust < 0 || rh->row_adjust > 15) {
-        VS_LOG(mtWarning, "invalid rowbytes_align requested, setting to 0");
+    RET_IF_WRITE_ERROR(!vi->format || vi->width == 0 || vi->height == 0,
+                       "clip must have constant format and dimensions");
+
+    rh->vi[0] = *vi;
+    set_args_int(&rh->row_adjust, 1, "rowbytes_align", &va);
+    set_args_data(rh->src_format, "Y4M", "format", FORMAT_MAX_LEN - 1, &va);
+
+    const char *y4m_tag = NULL;
+    if (strcasecmp(rh->src_format, "Y4M") == 0) {
         rh->row_adjust = 0;
+        y4m_tag = find_y4m_format(rh, vi->format, &va);
+        RET_IF_WRITE_ERROR(!y4m_tag, "%s can't be written as YUV4MPEG2", vi->format->name);
+    } else {
+        rh->row_adjust--;
+        RET_IF_WRITE_ERROR(rh->row_adjust < 0 || rh->row_adjust > 15, "invalid rowbytes_align");
+        const char *ca = check_args(rh, &va);
+        RET_IF_WRITE_ERROR(ca, "%s", ca);
+        RET_IF_WRITE_ERROR(rh->vi[0].format->id != vi->format->id,
+                           "clip must be %s to be written as %s",
+                           rh->vi[0].format->name, rh->src_format);
     }
 
-    const char *ca = check_args(rh, &va);
-    RET_IF_ERROR(ca, "%s", ca);
-
-    if (rh->file_size < 0)
-    {
-        // pipe: make the source "infinite"
-        // note: INT32_MAX doesn't work with some plugins (MVTools), use large number
-        rh->vi[0].numFrames = 30*60*60*6;
-        rh->index = NULL;
+    if (alpha) {
+        const VSVideoInfo *avi = vsapi->getVideoInfo(alpha);
+        RET_IF_WRITE_ERROR(!rh->has_alpha, "%s has no alpha channel", rh->src_format);
+        RET_IF_WRITE_ERROR(!avi->format || avi->format->colorFamily != cmGray ||
+                           avi->format->bytesPerSample != vi->format->bytesPerSample ||
+                           avi->width != vi->width || avi->height != vi->height ||
+                           avi->numFrames < vi->numFrames,
+                           "alpha clip doesn't match the clip");
+    } else if (rh->has_alpha) {
+        rh->opaque_row = alloc_opaque_row(rh);
+        RET_IF_WRITE_ERROR(!rh->opaque_row, "failed to allocate buffer");
     }
-    else
-    {
-        rh->vi[0].numFrames =
-            (int)((rh->file_size - rh->off_header) / (rh->off_frame + rh->frame_size));
 
-        RET_IF_ERROR(rh->vi[0].numFrames < 1, "too small file size");
-        RET_IF_ERROR(create_index(rh), "failed to create index");
+    int direct;
+    set_args_int(&direct, 0, "direct", &va);
+
+    const char *output = vsapi->propGetData(in, "output", 0, 0);
+#ifdef _WIN32
+    wchar_t tmp[FILENAME_MAX * 4];
+    MultiByteToWideChar(CP_UTF8, 0, output, -1, tmp, FILENAME_MAX * 4);
+    int fd = _wopen(tmp, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    int fd = -1;
+#ifdef O_DIRECT
+    if (direct) {
+        fd = open(output, flags | O_DIRECT, 0644);
+        if (fd < 0)
+            VS_LOG(mtWarning, "O_DIRECT isn't supported for %s, using buffered writes", output);
     }
+#endif
+    if (fd < 0)
+        fd = open(output, flags, 0644);
+#endif
+    RET_IF_WRITE_ERROR(fd < 0, "failed to open output file");
+
+    rs_writer_t w = { { node, alpha }, alpha ? 2 : 1 };
+    w.fd = fd;
+    set_args_int(&w.num_slots, vsapi->getCoreInfo(core)->numThreads, "prefetch", &va);
+    if (w.num_slots < 1)
+        w.num_slots = 1;
+
+    // room for the carried tail, the y4m headers and the frame itself
+    size_t capacity = rh->frame_size + WRITE_ALIGN + 256;
+    int ok = 1;
+    for (int i = 0; i < 2; i++) {
+        w.buff[i] = alloc_buffer(capacity, rh->hugepages, &w.buff_mapped[i]);
+        ok &= w.buff[i] != NULL;
+    }
+    w.slots = (rs_fetch_slot_t *)calloc(w.num_slots, sizeof(rs_fetch_slot_t));
+    ok &= w.slots != NULL;
+
+    rs_thread_t thread;
+    const char *write_err = "failed to allocate buffer";
+    int num_frames = 0;
+    if (ok) {
+        for (int i = 0; i < w.num_slots; i++)
+            rs_sem_init(&w.slots[i].ready, 0);
+        rs_sem_init(&w.free, 2);
+        rs_sem_init(&w.full, 0);
+
+        if (rs_thread_create(&thread, write_thread, &w) == 0) {
+            write_err = write_clip(rh, &w, y4m_tag, &num_frames, vsapi);
+            w.quit = 1;
+            rs_sem_post(&w.full);
+            rs_thread_join(thread);
+        } else {
+            write_err = "failed to create writer thread";
+        }
 
-    rh->frame_buff = (uint8_t *)malloc(rh->frame_size + 32);
-    RET_IF_ERROR(!rh->frame_buff, "failed to allocate buffer");
+        for (int i = 0; i < w.num_slots; i++)
+            rs_sem_destroy(&w.slots[i].ready);
+        rs_sem_destroy(&w.free);
+        rs_sem_destroy(&w.full);
+    }
 
-    if (rh->has_alpha) {
-        rh->vi[1] = rh->vi[0];
-        VSPresetFormat pf =
-            rh->vi[0].format->bytesPerSample == 1 ? pfGray8 : pfGray16;
-        rh->vi[1].format = vsapi->getFormatPreset(pf, core);
+    for (int i = 0; i < 2; i++) {
+        if (w.buff[i])
+            free_buffer(w.buff[i], w.buff_mapped[i]);
     }
+    free(w.slots);
+#ifdef _WIN32
+    _close(fd);
+#else
+    close(fd);
+#endif
 
-    // nfNoCache because the system file cache is used
-    // nfMakeLinear because disk drives are faster in sequential access
-    int flags = nfNoCache | nfMakeLinear;
+    RET_IF_WRITE_ERROR(write_err, "%s", write_err);
+#undef RET_IF_WRITE_ERROR
 
-    // fmUnordered since get_frame isn't reentrant; even for the non-pipe case,
-    // the same rh->frame_buff will be used to service parallel requests
-    vsapi->createFilter(in, out, "Source", vs_init, rs_get_frame, vs_close,
-                        fmUnordered, flags, rh, core);
+    vsapi->freeNode(node);
+    vsapi->freeNode(alpha);
+
+    vsapi->propSetInt(out, "frames", num_frames, paReplace);
+    close_handler(rh);
 }
 #undef RET_IF_ERROR
 
@@ -1126,8 +5475,25 @@ VS_EXTERNAL_API(void) VapourSynthPluginInit(
     f_config("chikuzen.does.not.have.his.own.domain.raws", "raws",
              "Raw-format file Reader for VapourSynth " VS_RAWS_VERSION,
              VAPOURSYNTH_API_VERSION, 1, plugin);
-    f_register("Source", "source:data;width:int:opt;height:int:opt;"
+    crc32c_init();
+    mipi_init();
+    half_init();
+    f_register("Source", "source:data[];width:int:opt;height:int:opt;"
+               "fpsnum:int:opt;fpsden:int:opt;sarnum:int:opt;sarden:int:opt;"
+               "src_fmt:data:opt;off_header:int:opt;off_frame:int:opt;"
+               "rowbytes_align:int:opt;hugepages:int:opt;"
+               "spool:int:opt;spool_frames:int:opt;crop_left:int:opt;crop_top:int:opt;"
+               "crop_width:int:opt;crop_height:int:opt;planes:int[]:opt;"
+               "start:int:opt;end:int:opt;step:int:opt;crc:int:opt;manifest:data:opt;"
+               "stats:int:opt;out_format:data:opt;stream:int:opt;plane_files:int:opt;"
+               "read_ahead:int:opt;follow:int:opt",
+               create_source, NULL, plugin);
+    f_register("Pack", "source:data[];output:data;codec:data:opt;level:int:opt;"
+               "width:int:opt;height:int:opt;"
                "fpsnum:int:opt;fpsden:int:opt;sarnum:int:opt;sarden:int:opt;"
                "src_fmt:data:opt;off_header:int:opt;off_frame:int:opt;"
-               "rowbytes_align:int:opt", create_source, NULL, plugin);
+               "rowbytes_align:int:opt", create_pack, NULL, plugin);
+    f_register("Write", "clip:clip;output:data;format:data:opt;alpha:clip:opt;"
+               "rowbytes_align:int:opt;direct:int:opt;prefetch:int:opt",
+               create_write, NULL, plugin);
 }
@@ -65,6 +65,100 @@
 #include <string.h>
 #include <stdarg.h>
 #include <inttypes.h>
+#include <float.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <limits.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <fcntl.h>    /* O_DIRECT */
+#include <sys/uio.h>  /* preadv() */
+#include <sys/mman.h> /* mmap(), madvise() */
+#define RS_HAVE_PREADV
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+#endif
+
+#ifdef __linux__
+#include <errno.h>
+#include <signal.h>       /* kill() */
+#include <poll.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#define RS_HAVE_SHM
+#define RS_HAVE_PIPE_FD
+#ifndef F_SETPIPE_SZ
+#define F_SETPIPE_SZ 1031   /* F_LINUX_SPECIFIC_BASE + 7, hidden without _GNU_SOURCE */
+#define F_GETPIPE_SZ 1032
+#endif
+#endif
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* crc32 instruction and pshufb, picked at runtime since SSE4.2 and SSSE3
+ * aren't in the baseline */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <nmmintrin.h>
+#define RS_HAVE_CRC32C_HW
+#define RS_HAVE_SSSE3
+/* half to float widening, __builtin_cpu_supports knows f16c from gcc 11 */
+#if __GNUC__ >= 11
+#include <immintrin.h>
+#define RS_HAVE_F16C
+#endif
+#endif
+
+#ifdef _WIN32
+typedef CRITICAL_SECTION rs_mutex_t;
+#define rs_mutex_init(m)    InitializeCriticalSection(m)
+#define rs_mutex_destroy(m) DeleteCriticalSection(m)
+#define rs_mutex_lock(m)    EnterCriticalSection(m)
+#define rs_mutex_unlock(m)  LeaveCriticalSection(m)
+
+typedef HANDLE rs_sem_t;
+#define rs_sem_init(s, n)   (*(s) = CreateSemaphore(NULL, n, LONG_MAX, NULL))
+#define rs_sem_destroy(s)   CloseHandle(*(s))
+#define rs_sem_wait(s)      WaitForSingleObject(*(s), INFINITE)
+#define rs_sem_post(s)      ReleaseSemaphore(*(s), 1, NULL)
+
+typedef HANDLE rs_thread_t;
+#define RS_THREAD_FUNC(name, arg) DWORD WINAPI name(LPVOID arg)
+#define RS_THREAD_RETURN    return 0
+#define rs_thread_create(t, func, arg) \
+    ((*(t) = CreateThread(NULL, 0, func, arg, 0, NULL)) == NULL)
+#define rs_thread_join(t)   (WaitForSingleObject(t, INFINITE), CloseHandle(t))
+#define rs_sleep_ms(ms)     Sleep(ms)
+#else
+typedef pthread_mutex_t rs_mutex_t;
+#define rs_mutex_init(m)    pthread_mutex_init(m, NULL)
+#define rs_mutex_destroy(m) pthread_mutex_destroy(m)
+#define rs_mutex_lock(m)    pthread_mutex_lock(m)
+#define rs_mutex_unlock(m)  pthread_mutex_unlock(m)
+
+typedef sem_t rs_sem_t;
+#define rs_sem_init(s, n)   sem_init(s, 0, n)
+#define rs_sem_destroy(s)   sem_destroy(s)
+#define rs_sem_wait(s)      while (sem_wait(s) != 0)
+#define rs_sem_post(s)      sem_post(s)
+
+typedef pthread_t rs_thread_t;
+#define RS_THREAD_FUNC(name, arg) void *name(void *arg)
+#define RS_THREAD_RETURN    return NULL
+#define rs_thread_create(t, func, arg) pthread_create(t, NULL, func, arg)
+#define rs_thread_join(t)   pthread_join(t, NULL)
+#define rs_sleep_ms(ms)     usleep((ms) * 1000)
+#endif
 
 typedef struct {
     uint32_t header_size;
@@ -80,5 +174,118 @@ typedef struct {
     uint32_t indx_palette;
 } bmp_info_header_t;
 
+/* DPX (SMPTE 268M), the part of the headers read by check_dpx.
+ * fields are in the byte order of the file, which the magic tells:
+ * "SDPX" is big endian, "XPDS" little endian. */
+#define DPX_MAGIC 0x53445058
+
+typedef struct {
+    uint32_t data_sign;
+    uint32_t ref_low_data;
+    float ref_low_quantity;
+    uint32_t ref_high_data;
+    float ref_high_quantity;
+    uint8_t descriptor;         /* 50: RGB */
+    uint8_t transfer;
+    uint8_t colorimetric;
+    uint8_t bit_size;
+    uint16_t packing;           /* 0: packed, 1: filled method A, 2: filled method B */
+    uint16_t encoding;          /* 0: uncompressed */
+    uint32_t data_offset;
+    uint32_t eol_padding;
+    uint32_t eoi_padding;
+    char description[32];
+} dpx_element_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t image_offset;
+    char version[8];
+    uint32_t file_size;
+    char file_info[748];        /* rest of the file information header */
+    uint16_t orientation;       /* 0: left to right, top to bottom */
+    uint16_t num_elements;
+    uint32_t pixels_per_line;
+    uint32_t lines_per_element;
+    dpx_element_t element[1];   /* the first of 8 */
+} dpx_header_t;
+
+/* chunk-compressed raw container (.rsz)
+ *
+ * rsz_header_t
+ * frame blocks, each compressed on its own with the codec of the header.
+ *     a block as large as frame_size is stored uncompressed.
+ * seek table, num_frames + 1 uint64_t file offsets of the blocks, the last
+ *     one being the end of the last block.
+ *
+ * all fields and the seek table are little endian, Pack and Source swap
+ * them on big endian hosts. */
+#define RSZ_SIGNATURE "RZRAW1\r\n"
+
+enum {
+    RSZ_CODEC_NONE = 0,
+    RSZ_CODEC_LZ4  = 1,
+    RSZ_CODEC_ZSTD = 2
+};
+
+#define RSZ_FLAG_FLIP_V 1       /* rows are stored bottom-up */
+
+typedef struct {
+    char signature[8];
+    uint64_t seek_table;        /* file offset of the seek table */
+    int64_t fps_num;
+    int64_t fps_den;
+    uint32_t header_size;
+    uint32_t codec;
+    int32_t width;
+    int32_t height;
+    int32_t sar_num;
+    int32_t sar_den;
+    int32_t rowbytes_align;
+    uint32_t frame_size;        /* uncompressed size of each frame */
+    uint32_t num_frames;
+    uint32_t flags;             /* RSZ_FLAG_* */
+    char src_fmt[32];
+} rsz_header_t;
+
+/* shared-memory frame ring (source "shm:/name"), written by one producer
+ * process and read by one Source. see test/shm-producer.c.
+ *
+ * rs_shm_header_t
+ * uint32_t slot_seq[num_slots], frame number + 1 of the frame in each slot,
+ *     0 while the producer writes it
+ * num_slots slots of slot_size bytes from data_offset, frame n in slot
+ *     n % num_slots.
+ *
+ * the producer waits until frame n - num_slots is released (read_seq),
+ * writes frame n, sets its slot_seq, then write_seq = n + 1 and wakes
+ * write_seq. after the last frame it sets eof and wakes write_seq.
+ * the reader waits on write_seq, converts straight from the slot and
+ * advances read_seq, waking it. write_seq and read_seq are futex words.
+ * the producer removes the ring after the reader has gone.
+ * fields are in host byte order. */
+#define RS_SHM_SIGNATURE "RSSHM1\r\n"
+
+typedef struct {
+    char signature[8];
+    uint32_t header_size;
+    uint32_t num_slots;
+    uint64_t slot_size;
+    uint64_t data_offset;       /* offset of slot 0 */
+    int64_t fps_num;
+    int64_t fps_den;
+    int32_t width;
+    int32_t height;
+    int32_t sar_num;
+    int32_t sar_den;
+    int32_t rowbytes_align;
+    int32_t producer_pid;       /* the ring ends if the producer is gone */
+    char src_fmt[32];
+    volatile uint32_t eof;
+    volatile uint32_t write_seq;    /* frames published */
+    volatile uint32_t read_seq;     /* frames released by the reader */
+    volatile int32_t reader_pid;    /* set by the reader once it has mapped the ring */
+} rs_shm_header_t;
+
 
 #endif /* VS_RAW_SOURCE_H */
@@ -0,0 +1,138 @@
+/*
+  shm-producer.c: reference producer of a shm: frame ring
+
+  This file is a part of vsrawsource
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with Libav; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+/* reads raw frames from stdin and publishes them in a shared memory ring
+ * for raws.Source('shm:/name'). the layout and protocol are described with
+ * rs_shm_header_t in rawsource.h.
+ *
+ * $ gcc -O2 -std=gnu99 -o shm-producer test/shm-producer.c -lrt
+ * $ ./shm-producer /cap 1920 1080 NV12 3110400 8 < cap.raw
+ */
+
+#include "../rawsource.h"
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: shm-producer name width height src_fmt frame_size [slots [fpsnum fpsden]]\n"
+            "  frame_size is the size of one frame of src_fmt in bytes, slots defaults to 8\n");
+    exit(1);
+}
+
+static void futex_wait(volatile uint32_t *addr, uint32_t val)
+{
+    syscall(SYS_futex, addr, FUTEX_WAIT, val, NULL, NULL, 0);
+}
+
+static void futex_wake(volatile uint32_t *addr)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 6 && argc != 7 && argc != 9)
+        usage();
+
+    const char *name = argv[1];
+    uint64_t frame_size = strtoull(argv[5], NULL, 10);
+    uint32_t num_slots = argc > 6 ? (uint32_t)atoi(argv[6]) : 8;
+    if (frame_size == 0 || num_slots == 0 || strlen(argv[4]) >= 32)
+        usage();
+
+    // slots are page aligned so that the reader's loads stay aligned
+    uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+    uint64_t slot_size = (frame_size + page - 1) / page * page;
+    uint64_t data_offset = (sizeof(rs_shm_header_t) + sizeof(uint32_t) * num_slots +
+                            page - 1) / page * page;
+    uint64_t size = data_offset + slot_size * num_slots;
+
+    shm_unlink(name);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 || ftruncate(fd, (off_t)size) != 0) {
+        perror("shm-producer: shm_open");
+        return 1;
+    }
+    uint8_t *map = (uint8_t *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("shm-producer: mmap");
+        shm_unlink(name);
+        return 1;
+    }
+
+    rs_shm_header_t *hdr = (rs_shm_header_t *)map;
+    uint32_t *slot_seq = (uint32_t *)(map + sizeof(rs_shm_header_t));
+    hdr->header_size = sizeof(rs_shm_header_t);
+    hdr->num_slots = num_slots;
+    hdr->slot_size = slot_size;
+    hdr->data_offset = data_offset;
+    hdr->width = atoi(argv[2]);
+    hdr->height = atoi(argv[3]);
+    hdr->fps_num = argc > 8 ? atoll(argv[7]) : 30000;
+    hdr->fps_den = argc > 8 ? atoll(argv[8]) : 1001;
+    hdr->sar_num = 1;
+    hdr->sar_den = 1;
+    hdr->rowbytes_align = 1;
+    hdr->producer_pid = (int32_t)getpid();
+    strcpy(hdr->src_fmt, argv[4]);
+    // the signature goes last, a reader never sees a half written header
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(hdr->signature, RS_SHM_SIGNATURE, sizeof(hdr->signature));
+
+    uint32_t n = 0;
+    for (;;) {
+        // wait for the reader to release the frame this slot holds. a reader
+        // skipping ahead releases frames that haven't been written yet
+        uint32_t released;
+        while ((int32_t)(n - (released = __atomic_load_n(&hdr->read_seq, __ATOMIC_ACQUIRE))) >=
+               (int32_t)num_slots)
+            futex_wait(&hdr->read_seq, released);
+
+        // the last frame stays readable when the input ends
+        int c = getc(stdin);
+        if (c == EOF)
+            break;
+        ungetc(c, stdin);
+
+        uint32_t slot = n % num_slots;
+        __atomic_store_n(&slot_seq[slot], 0, __ATOMIC_RELEASE);
+        uint8_t *dst = map + data_offset + slot * slot_size;
+        if (fread(dst, 1, frame_size, stdin) != frame_size)
+            break;
+
+        __atomic_store_n(&slot_seq[slot], n + 1, __ATOMIC_RELEASE);
+        __atomic_store_n(&hdr->write_seq, n + 1, __ATOMIC_RELEASE);
+        futex_wake(&hdr->write_seq);
+        n++;
+    }
+
+    __atomic_store_n(&hdr->eof, 1, __ATOMIC_RELEASE);
+    futex_wake(&hdr->write_seq);
+    fprintf(stderr, "shm-producer: %u frames\n", n);
+
+    // the ring stays until the reader that mapped it has gone
+    while (hdr->reader_pid == 0 || kill(hdr->reader_pid, 0) == 0 || errno != ESRCH)
+        usleep(100 * 1000);
+
+    munmap(map, size);
+    shm_unlink(name);
+    return 0;
+}
@@ -50,11 +50,12 @@ function split {
         IFS=',';
         set -- $arg;
 
-        echo $1 $2 $3
+        echo $1 $2 $3 $4
     `
     _1=$1
     _2=$2
     _3=$3
+    _4=$4
 }
 
 function compare {
@@ -143,6 +144,64 @@ do
     compare "$srcSum" "$echoSum"
 done
 
+# test packed formats that ffmpeg knows by other names, some of them widened
+# or narrowed by out_format to the depth of the planar format
+# ffmpeg(fmt) | ffmpeg(planarFmt) == ffmpeg(fmt) | vspipe(srcFmt, outFmt)
+for fmt in \
+    vuya,VUYA,yuv444p uyva,UYVA,yuv444p \
+    xv30le,Y410,yuv444p10le xv36le,Y416,yuv444p12le,YUV444P12 \
+    y210le,Y210,yuv422p10le,YUV422P10 y216le,Y216,yuv422p16le
+do
+    split $fmt
+    packedFmt=$_1
+    srcFmt=$_2
+    planarFmt=$_3
+    outFmt=$_4
+
+    echo -e \\n== Packed $packedFmt as $srcFmt =\> $planarFmt ===============================
+
+    # first pass, checksum the source clip w/o raws
+    srcSum=`ffmpeg -loglevel warning -i "$input" -frames $numFrames -pix_fmt $packedFmt -f rawvideo - | \
+            ffmpeg -loglevel warning -f rawvideo -pixel_format $packedFmt -video_size ${width}x${height} \
+                -i - -frames $numFrames -pix_fmt $planarFmt -f rawvideo - |
+            openssl md5`
+
+    # second pass, same source clip piped through raws
+    echoSum=`ffmpeg -loglevel warning  -i "$input" -frames $numFrames -pix_fmt $packedFmt -f rawvideo - | \
+            vspipe --requests $requests --end $(($numFrames-1)) --arg fmt_=$width:$height:$srcFmt:0:0:$outFmt echo-raw.vpy - | \
+            openssl md5`
+
+    compare "$srcSum" "$echoSum"
+done
+
+# test packed float rgb against ffmpeg's planar float, with the planes in gbr order.
+# half floats are widened by out_format, through F16C when the cpu has it
+# ffmpeg(fmt) | ffmpeg(gbrpf32le) == ffmpeg(fmt) | vspipe(srcFmt, outFmt)
+for fmt in \
+    rgbf32le,RGBF32 rgbaf32le,RGBAF32 \
+    rgbf16le,RGBF16,RGBS rgbaf16le,RGBAF16,RGBS
+do
+    split $fmt
+    packedFmt=$_1
+    srcFmt=$_2
+    outFmt=$_3
+
+    echo -e \\n== Float $packedFmt as $srcFmt =\> gbrpf32le ===============================
+
+    # first pass, checksum the source clip w/o raws
+    srcSum=`ffmpeg -loglevel warning -i "$input" -frames $numFrames -pix_fmt $packedFmt -f rawvideo - | \
+            ffmpeg -loglevel warning -f rawvideo -pixel_format $packedFmt -video_size ${width}x${height} \
+                -i - -frames $numFrames -pix_fmt gbrpf32le -f rawvideo - |
+            openssl md5`
+
+    # second pass, same source clip piped through raws
+    echoSum=`ffmpeg -loglevel warning  -i "$input" -frames $numFrames -pix_fmt $packedFmt -f rawvideo - | \
+            vspipe --requests $requests --end $(($numFrames-1)) --arg fmt_=$width:$height:$srcFmt:1:0:$outFmt echo-raw.vpy - | \
+            openssl md5`
+
+    compare "$srcSum" "$echoSum"
+done
+
 # test rgb formats usable with bmp pipe
 for fmt in \
     bgr24,gbrp bgra,gbrp
@@ -273,6 +332,38 @@ do
     compare "$srcSum" "$echoSum"
 done
 
+# test planes read from files of their own, cropped and converted with out_format
+# vspipe(file) == vspipe(plane files)
+for fmt in \
+    yuv420p,I420,YUV420PS yuv420p10le,YUV420P10,YUV420P16 yuv444p16le,YUV444P16,YUV444PS
+do
+    split $fmt
+    ffFmt=$_1
+    srcFmt=$_2
+    outFmt=$_3
+
+    echo -e \\n== Plane files $srcFmt =\> $outFmt ===============================
+
+    ffmpeg -loglevel warning -i "$input" -frames $numFrames -pix_fmt $ffFmt -f rawvideo -y "$input.raw"
+    ffmpeg -loglevel warning -i "$input" -frames $numFrames \
+        -filter_complex "format=$ffFmt,extractplanes=y+u+v[y][u][v]" \
+        -map "[y]" -f rawvideo -y "$input.y.raw" \
+        -map "[u]" -f rawvideo -y "$input.u.raw" \
+        -map "[v]" -f rawvideo -y "$input.v.raw"
+
+    srcSum=`vspipe --requests $requests --end $(($numFrames-1)) --arg files_="$input.raw" \
+                --arg fmt_=$width:$height:$srcFmt:$outFmt echo-planes.vpy - | \
+            openssl md5`
+
+    echoSum=`vspipe --requests $requests --end $(($numFrames-1)) --arg files_="$input.y.raw,$input.u.raw,$input.v.raw" \
+                --arg fmt_=$width:$height:$srcFmt:$outFmt echo-planes.vpy - | \
+            openssl md5`
+
+    rm -f "$input.raw" "$input.y.raw" "$input.u.raw" "$input.v.raw"
+
+    compare "$srcSum" "$echoSum"
+done
+
 echo ---------------------------------------------------
 echo $0 \| PASS $numPass \| FAIL $numFail
 